@@ -0,0 +1,297 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <thread>
+#include "../src/Parallel/Scheduler.hpp"
+
+/* builds canonical task graphs and times them on pools of increasing size against
+running the same tasks serially. run with --help for the options */
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+   size_t size = 10000;      // tasks per graph, approximately for the tree and wavefront
+   unsigned grain = 1000;    // loop iterations per task
+   double density = 0.001;   // chance of an edge between two tasks of a random graph
+   int reps = 10;            // timed runs per configuration
+   std::vector<int> threads; // pool sizes, 1 up to the hardware's by doubling if empty
+   std::vector<std::string> shapes{"chain", "fanout", "tree", "wavefront", "random"};
+   Parallel::StealPolicy policy = Parallel::StealPolicy::nearest;
+   Parallel::Affinity affinity = Parallel::Affinity::floating;
+};
+
+/* one task's work, a loop the compiler cannot remove */
+void spin(const unsigned grain) {
+   volatile unsigned sink = 0;
+   for (unsigned i = 0; i < grain; i++) {
+      sink = sink + i;
+   }
+}
+
+double seconds_since(const Clock::time_point start) {
+   return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/* adds n tasks to the scheduler */
+std::vector<Parallel::Task> add_tasks(Parallel::Scheduler &graph, const size_t n,
+ const unsigned grain) {
+   std::vector<Parallel::Task> tasks;
+   tasks.reserve(n);
+   for (size_t i = 0; i < n; i++) {
+      tasks.push_back(graph.silent_add([grain]() { spin(grain); }));
+   }
+   return tasks;
+}
+
+/* each task depends on the one before it, no parallelism at all */
+size_t build_chain(Parallel::Scheduler &graph, const Options &opts) {
+   auto tasks = add_tasks(graph, opts.size, opts.grain);
+   for (size_t i = 1; i < tasks.size(); i++) {
+      graph.direct(tasks[i - 1], tasks[i]);
+   }
+   return tasks.size();
+}
+
+/* one source feeding every other task, all of which feed one sink */
+size_t build_fanout(Parallel::Scheduler &graph, const Options &opts) {
+   const size_t n = std::max<size_t>(opts.size, 3);
+   auto tasks = add_tasks(graph, n, opts.grain);
+   for (size_t i = 1; i + 1 < n; i++) {
+      graph.direct(tasks[0], tasks[i]);
+      graph.direct(tasks[i], tasks[n - 1]);
+   }
+   return n;
+}
+
+/* a reduction tree, each task depending on its two children, leaves first */
+size_t build_tree(Parallel::Scheduler &graph, const Options &opts) {
+   const size_t n = std::max<size_t>(opts.size, 1);
+   auto tasks = add_tasks(graph, n, opts.grain);
+   // heap layout, node i has children 2i+1 and 2i+2
+   for (size_t i = 1; i < n; i++) {
+      graph.direct(tasks[i], tasks[(i - 1) / 2]);
+   }
+   return n;
+}
+
+/* a square grid where each cell depends on the cells above and to its left, so
+parallelism rises and falls along the anti-diagonals */
+size_t build_wavefront(Parallel::Scheduler &graph, const Options &opts) {
+   size_t side = 1;
+   while ((side + 1) * (side + 1) <= opts.size) {
+      side++;
+   }
+   auto tasks = add_tasks(graph, side * side, opts.grain);
+   for (size_t row = 0; row < side; row++) {
+      for (size_t col = 0; col < side; col++) {
+         if (row > 0) {
+            graph.direct(tasks[(row - 1) * side + col], tasks[row * side + col]);
+         }
+         if (col > 0) {
+            graph.direct(tasks[row * side + col - 1], tasks[row * side + col]);
+         }
+      }
+   }
+   return tasks.size();
+}
+
+/* edges only run from lower to higher indices, so the graph is acyclic. a fixed
+seed keeps the graph the same between runs of the benchmark. gaps between edges
+are drawn geometrically, so building costs the number of edges, not n squared */
+size_t build_random(Parallel::Scheduler &graph, const Options &opts) {
+   auto tasks = add_tasks(graph, opts.size, opts.grain);
+   if (opts.density <= 0.0) {
+      return tasks.size();
+   }
+   std::mt19937_64 rng{42};
+   // the distribution needs p below 1, which is as dense as makes no difference
+   std::geometric_distribution<size_t> gap{std::min(opts.density, 0.999999)};
+   for (size_t from = 0; from < tasks.size(); from++) {
+      for (size_t to = from + 1 + gap(rng); to < tasks.size(); to += 1 + gap(rng)) {
+         graph.direct(tasks[from], tasks[to]);
+      }
+   }
+   return tasks.size();
+}
+
+using Builder = std::function<size_t(Parallel::Scheduler&, const Options&)>;
+
+Builder builder_of(const std::string &shape) {
+   if (shape == "chain") {
+      return build_chain;
+   } else if (shape == "fanout") {
+      return build_fanout;
+   } else if (shape == "tree") {
+      return build_tree;
+   } else if (shape == "wavefront") {
+      return build_wavefront;
+   } else if (shape == "random") {
+      return build_random;
+   }
+   return nullptr;
+}
+
+double median(std::vector<double> samples) {
+   std::sort(samples.begin(), samples.end());
+   return samples[samples.size() / 2];
+}
+
+/* the same number of task bodies run back to back on this thread */
+double serial_baseline(const size_t num_tasks, const Options &opts) {
+   std::vector<double> samples;
+   for (int rep = 0; rep < opts.reps; rep++) {
+      const auto start = Clock::now();
+      for (size_t i = 0; i < num_tasks; i++) {
+         spin(opts.grain);
+      }
+      samples.push_back(seconds_since(start));
+   }
+   return median(samples);
+}
+
+void bench_shape(const std::string &shape, const Options &opts) {
+   const Builder build = builder_of(shape);
+   std::printf("\n%s, grain %u\n", shape.c_str(), opts.grain);
+   std::printf("%8s %8s %12s %12s %12s %14s %9s %9s\n", "threads", "tasks", "build ms",
+      "first ms", "median ms", "tasks/s", "speedup", "effic.");
+   double serial = 0.0;
+   for (const int count : opts.threads) {
+      Parallel::ThreadPool pool{count, opts.affinity, opts.policy};
+      Parallel::Scheduler graph{pool};
+      auto start = Clock::now();
+      const size_t num_tasks = build(graph, opts);
+      graph.compile();
+      const double build_time = seconds_since(start);
+      if (serial == 0.0) {
+         serial = serial_baseline(num_tasks, opts);
+         std::printf("%8s %8zu %12s %12s %12.3f %14.0f %9s %9s\n", "serial", num_tasks, "-",
+            "-", serial * 1e3, num_tasks / serial, "1.00", "-");
+      }
+      // the first run pays for waking the workers and touching the graph
+      start = Clock::now();
+      graph.execute();
+      graph.wait();
+      const double first = seconds_since(start);
+      std::vector<double> samples;
+      for (int rep = 0; rep < opts.reps; rep++) {
+         start = Clock::now();
+         graph.execute();
+         graph.wait();
+         samples.push_back(seconds_since(start));
+      }
+      const double typical = median(samples);
+      std::printf("%8d %8zu %12.3f %12.3f %12.3f %14.0f %9.2f %8.1f%%\n", count, num_tasks,
+         build_time * 1e3, first * 1e3, typical * 1e3, num_tasks / typical, serial / typical,
+         100.0 * serial / (typical * count));
+   }
+}
+
+void usage() {
+   std::cout <<
+      "usage: dagbench [options]\n"
+      "   --shapes a,b,...   chain, fanout, tree, wavefront, random (default all)\n"
+      "   --size n           tasks per graph (default 10000)\n"
+      "   --grain n          loop iterations per task (default 1000)\n"
+      "   --density p        edge probability of random graphs (default 0.001)\n"
+      "   --threads a,b,...  pool sizes (default 1, 2, 4 ... up to the cpu count)\n"
+      "   --reps n           timed runs per pool size (default 10)\n"
+      "   --policy name      nearest, randomized or batched stealing (default nearest)\n"
+      "   --pinned           pin each worker to a cpu\n";
+}
+
+std::vector<std::string> split(const std::string &list) {
+   std::vector<std::string> items;
+   size_t pos = 0;
+   while (pos <= list.size()) {
+      size_t end = list.find(',', pos);
+      if (end == std::string::npos) {
+         end = list.size();
+      }
+      if (end > pos) {
+         items.push_back(list.substr(pos, end - pos));
+      }
+      pos = end + 1;
+   }
+   return items;
+}
+
+bool parse(int argc, char **argv, Options &opts) {
+   for (int i = 1; i < argc; i++) {
+      const std::string arg = argv[i];
+      if (arg == "--pinned") {
+         opts.affinity = Parallel::Affinity::pinned;
+         continue;
+      }
+      if (arg == "--help" || i + 1 == argc) {
+         return false;
+      }
+      const std::string value = argv[++i];
+      if (arg == "--shapes") {
+         opts.shapes = split(value);
+      } else if (arg == "--size") {
+         opts.size = std::stoul(value);
+      } else if (arg == "--grain") {
+         opts.grain = std::stoul(value);
+      } else if (arg == "--density") {
+         opts.density = std::stod(value);
+      } else if (arg == "--reps") {
+         opts.reps = std::max(1, std::stoi(value));
+      } else if (arg == "--threads") {
+         for (auto &item : split(value)) {
+            opts.threads.push_back(std::max(1, std::stoi(item)));
+         }
+      } else if (arg == "--policy") {
+         if (value == "nearest") {
+            opts.policy = Parallel::StealPolicy::nearest;
+         } else if (value == "randomized") {
+            opts.policy = Parallel::StealPolicy::randomized;
+         } else if (value == "batched") {
+            opts.policy = Parallel::StealPolicy::batched;
+         } else {
+            return false;
+         }
+      } else {
+         return false;
+      }
+   }
+   for (auto &shape : opts.shapes) {
+      if (builder_of(shape) == nullptr) {
+         std::cerr << "unknown shape " << shape << '\n';
+         return false;
+      }
+   }
+   return true;
+}
+
+int main(int argc, char **argv) {
+   Options opts;
+   try {
+      if (!parse(argc, argv, opts)) {
+         usage();
+         return 1;
+      }
+   } catch (const std::exception&) {
+      usage();
+      return 1;
+   }
+   if (opts.threads.empty()) {
+      const int cpus = std::max(1u, std::thread::hardware_concurrency());
+      for (int count = 1; count < cpus; count *= 2) {
+         opts.threads.push_back(count);
+      }
+      opts.threads.push_back(cpus);
+   }
+   std::printf("dagbench: %zu tasks, grain %u, %d reps, %u cpus\n", opts.size, opts.grain,
+      opts.reps, std::max(1u, std::thread::hardware_concurrency()));
+   for (auto &shape : opts.shapes) {
+      bench_shape(shape, opts);
+   }
+   return 0;
+}
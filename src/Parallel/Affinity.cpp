@@ -0,0 +1,178 @@
+#include "Affinity.hpp"
+
+#include <thread>
+#include <fstream>
+#include <algorithm>
+#include <tuple>
+#include <map>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+#endif
+
+namespace Parallel {
+
+namespace {
+
+const std::string sysfs_cpu = "/sys/devices/system/cpu/cpu";
+
+std::string read_line(const std::string &path) {
+   std::ifstream file{path};
+   std::string line;
+   std::getline(file, line);
+   return line;
+}
+
+/* lowest cpu in a sysfs cpu list file, -1 if the file is missing */
+int first_cpu(const std::string &path) {
+   std::vector<int> cpus = parse_cpu_list(read_line(path));
+   return cpus.empty() ? -1 : *std::min_element(cpus.begin(), cpus.end());
+}
+
+#ifdef __linux__
+int cache_of(const int cpu, const int level) {
+   for (int index = 0; ; index++) {
+      const std::string dir = sysfs_cpu + std::to_string(cpu) + "/cache/index" + std::to_string(index);
+      const std::string found = read_line(dir + "/level");
+      if (found.empty()) {
+         return -1;
+      }
+      const std::string type = read_line(dir + "/type");
+      if (std::stoi(found) == level && type != "Instruction") {
+         return first_cpu(dir + "/shared_cpu_list");
+      }
+   }
+}
+
+int node_of(const int cpu) {
+   const std::string dir = sysfs_cpu + std::to_string(cpu);
+   DIR *entries = opendir(dir.c_str());
+   if (entries == nullptr) {
+      return -1;
+   }
+   int node = -1;
+   while (dirent *entry = readdir(entries)) {
+      const std::string name = entry->d_name;
+      if (name.size() > 4 && name.compare(0, 4, "node") == 0
+       && std::all_of(name.begin() + 4, name.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+         node = std::stoi(name.substr(4));
+         break;
+      }
+   }
+   closedir(entries);
+   return node;
+}
+#endif
+
+}
+
+std::vector<int> parse_cpu_list(const std::string &list) {
+   std::vector<int> cpus;
+   size_t pos = 0;
+   while (pos < list.size()) {
+      size_t end = list.find(',', pos);
+      if (end == std::string::npos) {
+         end = list.size();
+      }
+      const std::string range = list.substr(pos, end - pos);
+      const size_t dash = range.find('-');
+      try {
+         if (dash == std::string::npos) {
+            cpus.push_back(std::stoi(range));
+         } else {
+            const int last = std::stoi(range.substr(dash + 1));
+            for (int cpu = std::stoi(range.substr(0, dash)); cpu <= last; cpu++) {
+               cpus.push_back(cpu);
+            }
+         }
+      } catch (const std::exception&) {
+         // not a number, skip the entry
+      }
+      pos = end + 1;
+   }
+   return cpus;
+}
+
+CpuTopology CpuTopology::detect() {
+   CpuTopology topology;
+#ifdef __linux__
+   cpu_set_t mask;
+   CPU_ZERO(&mask);
+   if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+      for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+         if (!CPU_ISSET(cpu, &mask)) {
+            continue;
+         }
+         const std::string dir = sysfs_cpu + std::to_string(cpu);
+         int core = first_cpu(dir + "/topology/thread_siblings_list");
+         topology.places.push_back(CpuPlace{
+            cpu, (core < 0) ? cpu : core, cache_of(cpu, 2), cache_of(cpu, 3), node_of(cpu)
+         });
+      }
+   }
+#endif
+   if (topology.places.empty()) {
+      const int count = std::max(1u, std::thread::hardware_concurrency());
+      for (int cpu = 0; cpu < count; cpu++) {
+         topology.places.push_back(CpuPlace{cpu, cpu, -1, -1, -1});
+      }
+   }
+   return topology;
+}
+
+std::vector<CpuPlace> CpuTopology::assign(const int count) const {
+   // hierarchy order groups cpus by node, then L3, then L2, then core
+   std::vector<CpuPlace> ordered = places;
+   std::stable_sort(ordered.begin(), ordered.end(), [](const CpuPlace &a, const CpuPlace &b) {
+      return std::tie(a.node, a.l3, a.l2, a.core) < std::tie(b.node, b.l3, b.l2, b.core);
+   });
+   // first cpu of each core, then second hardware threads, and so on
+   std::map<int, int> seen;
+   std::vector<std::pair<int, CpuPlace>> ranked;
+   for (auto &place : ordered) {
+      ranked.emplace_back(seen[place.core]++, place);
+   }
+   std::stable_sort(ranked.begin(), ranked.end(), 
+      [](const auto &a, const auto &b) { return a.first < b.first; });
+   std::vector<CpuPlace> rounds;
+   for (auto &entry : ranked) {
+      rounds.push_back(entry.second);
+   }
+   std::vector<CpuPlace> assigned;
+   for (int i = 0; i < count; i++) {
+      assigned.push_back(rounds[i % rounds.size()]);
+   }
+   return assigned;
+}
+
+int CpuTopology::distance(const CpuPlace &a, const CpuPlace &b) {
+   auto same = [](int x, int y) { return x >= 0 && x == y; };
+   if (a.cpu == b.cpu) {
+      return 0;
+   } else if (same(a.core, b.core)) {
+      return 1;
+   } else if (same(a.l2, b.l2)) {
+      return 2;
+   } else if (same(a.l3, b.l3)) {
+      return 3;
+   } else if (same(a.node, b.node)) {
+      return 4;
+   }
+   return 5;
+}
+
+bool pin_thread(const int cpu) {
+#ifdef __linux__
+   cpu_set_t mask;
+   CPU_ZERO(&mask);
+   CPU_SET(cpu, &mask);
+   return pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) == 0;
+#else
+   (void)cpu;
+   return false;
+#endif
+}
+
+}
@@ -0,0 +1,50 @@
+#ifndef AFFINITYHPP
+#define AFFINITYHPP
+
+#include <vector>
+#include <string>
+
+namespace Parallel {
+
+/* whether a pool's workers float across cpus or are each pinned to one */
+enum class Affinity { floating, pinned };
+
+/* where a logical cpu sits in the cache and memory hierarchy. a cache or core is
+identified by the lowest cpu sharing it, and -1 marks a level the kernel does not
+report */
+struct CpuPlace {
+   int cpu;
+   int core;
+   int l2;
+   int l3;
+   int node;
+};
+
+/* the cpus this process may run on, read from its affinity mask and from sysfs */
+class CpuTopology {
+   public:
+      static CpuTopology detect();
+
+      const std::vector<CpuPlace> &cpus() const { return places; }
+      bool empty() const { return places.empty(); }
+
+      /* cpus for count workers, one per core before any core is given a second
+      worker, and in hierarchy order so that consecutive workers share caches */
+      std::vector<CpuPlace> assign(const int count) const;
+
+      /* how far apart two cpus are, from 0 for the same cpu through sharing a core,
+      an L2, an L3 and a NUMA node, to 5 for cpus on different nodes */
+      static int distance(const CpuPlace &a, const CpuPlace &b);
+   private:
+      std::vector<CpuPlace> places;
+};
+
+/* pins the calling thread to a cpu, false if the system refuses */
+bool pin_thread(const int cpu);
+
+/* parses a sysfs cpu list such as "0-3,8,10-11" */
+std::vector<int> parse_cpu_list(const std::string &list);
+
+}
+
+#endif
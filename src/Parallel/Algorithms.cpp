@@ -0,0 +1,78 @@
+#include "Algorithms.hpp"
+
+#include <utility>
+
+namespace Parallel {
+
+JobGroup::JobGroup(ThreadPool *pool) : pool{resolve(pool)}, failed{false} {
+   // held by the group until join(), so the count only returns to one once jobs are done
+   root.num_children.store(1, std::memory_order_relaxed);
+}
+
+ThreadPool *JobGroup::resolve(ThreadPool *pool) {
+   if (pool != nullptr) {
+      return pool;
+   }
+   Worker *worker = Worker::this_worker();
+   return (worker != nullptr) ? worker->employer : nullptr;
+}
+
+bool JobGroup::starved() const {
+   if (pool == nullptr) {
+      return false;
+   }
+   Worker *worker = Worker::this_worker();
+   if (worker != nullptr && worker->employer == pool) {
+      return !worker->has_queued();
+   }
+   return pool->num_submitted.load(std::memory_order_relaxed) == 0;
+}
+
+void JobGroup::join() {
+   wait_for_jobs();
+   std::exception_ptr thrown;
+   {
+      std::lock_guard locker{lck_jobs};
+      thrown = std::exchange(error, nullptr);
+   }
+   failed.store(false, std::memory_order_relaxed);
+   if (thrown != nullptr) {
+      std::rethrow_exception(thrown);
+   }
+}
+
+void JobGroup::fail(std::exception_ptr thrown) {
+   std::lock_guard locker{lck_jobs};
+   if (error == nullptr) {
+      error = std::move(thrown);
+   }
+   failed.store(true, std::memory_order_release);
+}
+
+void JobGroup::wait_for_jobs() {
+   if (pool == nullptr) {
+      return;
+   }
+   Worker *worker = Worker::this_worker();
+   if (worker != nullptr && worker->employer == pool) {
+      worker->corun(root.num_children, 1);
+   } else {
+      pool->wait_until([this]() { 
+         return root.num_children.load(std::memory_order_acquire) == 1; 
+      });
+   }
+   std::lock_guard locker{lck_jobs};
+   jobs.clear();
+}
+
+void JobGroup::submit(TaskInfo *job) {
+   pool->num_jobs.fetch_add(1, std::memory_order_relaxed);
+   Worker *worker = Worker::this_worker();
+   if (worker != nullptr && worker->employer == pool) {
+      worker->submit(job);
+   } else {
+      pool->schedule(job);
+   }
+}
+
+}
@@ -0,0 +1,335 @@
+#ifndef ALGORITHMSHPP
+#define ALGORITHMSHPP
+
+#include <mutex>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <vector>
+#include <optional>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+#include <type_traits>
+
+#include "Task.hpp"
+#include "ThreadPool.hpp"
+
+namespace Parallel {
+
+/* jobs forked by one call of an algorithm and joined before it returns. jobs are
+tasks outside any graph, children of a root node held by the joining thread, so
+they complete through the same path as the children of a subflow */
+class JobGroup {
+   public:
+      /* forks onto pool, or onto the calling worker's pool if null. off any pool
+      every job runs inline */
+      JobGroup(ThreadPool *pool);
+      ~JobGroup() { wait_for_jobs(); }
+      JobGroup(JobGroup&) =delete;
+      JobGroup &operator=(JobGroup&) =delete;
+
+      template<typename Func>
+      void fork(Func &&job);
+
+      /* true if a thread looking for work would find none queued by the caller,
+      the cue for lazy binary splitting to give some away */
+      bool starved() const;
+
+      /* blocks until every forked job has finished, a worker runs queued tasks
+      while it waits. rethrows the first exception a job threw; jobs forked after 
+      a failure are skipped */
+      void join();
+
+      /* number of threads the jobs may run on */
+      int concurrency() const { return (pool != nullptr) ? pool->size() : 1; }
+
+      /* the pool a group made with pool forks onto, null off any pool */
+      static ThreadPool *resolve(ThreadPool *pool);
+   private:
+      void submit(TaskInfo *job);
+      void fail(std::exception_ptr thrown);
+      void wait_for_jobs();
+
+      ThreadPool *pool;
+      TaskInfo root;
+      std::mutex lck_jobs;
+      std::vector<std::unique_ptr<TaskInfo>> jobs;
+      std::atomic<bool> failed;
+      std::exception_ptr error;
+};
+
+/* applies body to every index in [first, last), or to every element of an iterator
+range. the range is run in chunks of grain iterations, and the rest of it is halved
+each time the running thread has nothing queued, so idle threads always have a
+large piece to steal. grain 0 picks one from the range size and pool size */
+template<typename It, typename Func>
+void parallel_for(ThreadPool &pool, It first, It last, Func &&body, size_t grain = 0);
+
+/* writes op applied to every element of [first, last) to the range starting at out */
+template<typename It, typename Out, typename Func>
+void parallel_transform(ThreadPool &pool, It first, It last, Out out, Func &&op,
+   size_t grain = 0);
+
+/* folds [first, last) onto init with op, which must be associative. elements are
+combined in range order, so op need not commute */
+template<typename It, typename T, typename Func>
+T parallel_reduce(ThreadPool &pool, It first, It last, T init, Func &&op, size_t grain = 0);
+
+/* writes the inclusive prefix combination of [first, last) under op to the range
+starting at out, which may be first itself. op must be associative */
+template<typename It, typename Out, typename Func>
+void parallel_scan(ThreadPool &pool, It first, It last, Out out, Func &&op);
+
+/* as above, on the calling worker's pool when pool is null, or inline off any pool.
+this is the form used by tasks in a graph */
+template<typename It, typename Func>
+void parallel_for(ThreadPool *pool, It first, It last, Func &&body, size_t grain = 0);
+template<typename It, typename Out, typename Func>
+void parallel_transform(ThreadPool *pool, It first, It last, Out out, Func &&op,
+   size_t grain = 0);
+template<typename It, typename T, typename Func>
+T parallel_reduce(ThreadPool *pool, It first, It last, T init, Func &&op, size_t grain = 0);
+template<typename It, typename Out, typename Func>
+void parallel_scan(ThreadPool *pool, It first, It last, Out out, Func &&op);
+
+/* Implementation */
+
+template<typename Func>
+void JobGroup::fork(Func &&job) {
+   if (pool == nullptr) {
+      job();
+      return;
+   }
+   auto node = std::make_unique<TaskInfo>(Executor::make_closure(
+      [this, job = std::forward<Func>(job)]() mutable {
+         if (failed.load(std::memory_order_acquire)) {
+            return;
+         }
+         try {
+            job();
+         } catch (...) {
+            fail(std::current_exception());
+         }
+      }
+   ));
+   node->parent = &root;
+   TaskInfo *raw = node.get();
+   {
+      std::lock_guard locker{lck_jobs};
+      jobs.push_back(std::move(node));
+   }
+   root.num_children.fetch_add(1, std::memory_order_relaxed);
+   submit(raw);
+}
+
+/* number of positions in a range, and the element a function sees at a position:
+the index itself over an integer range, the referenced element over iterators */
+template<typename It>
+size_t range_size(It first, It last) {
+   if constexpr (std::is_integral_v<It>) {
+      return (first < last) ? static_cast<size_t>(last - first) : 0;
+   } else {
+      const auto distance = std::distance(first, last);
+      return (distance > 0) ? static_cast<size_t>(distance) : 0;
+   }
+}
+
+template<typename It>
+decltype(auto) element(It first, size_t offset) {
+   if constexpr (std::is_integral_v<It>) {
+      return static_cast<It>(first + static_cast<It>(offset));
+   } else {
+      return *(first + static_cast<typename std::iterator_traits<It>::difference_type>(offset));
+   }
+}
+
+inline size_t pick_grain(size_t count, const JobGroup &group, size_t grain) {
+   if (grain != 0) {
+      return grain;
+   }
+   // small enough that every thread gets many chunks, large enough to hide the check
+   return std::max<size_t>(1, count / (static_cast<size_t>(group.concurrency()) * 64));
+}
+
+/* lazy binary splitting of [begin, end): chunks of grain run here until the thread's
+queue is empty, then the upper half of what is left is forked as a job */
+template<typename Chunk>
+void split_range(JobGroup &group, size_t begin, size_t end, size_t grain, Chunk &chunk) {
+   while (end - begin > grain) {
+      if (group.starved()) {
+         const size_t mid = begin + (end - begin) / 2;
+         group.fork([&group, mid, end, grain, &chunk]() {
+            split_range(group, mid, end, grain, chunk);
+         });
+         end = mid;
+      } else {
+         chunk(begin, begin + grain);
+         begin += grain;
+      }
+   }
+   if (begin < end) {
+      chunk(begin, end);
+   }
+}
+
+template<typename It, typename Func>
+void parallel_for(ThreadPool *pool, It first, It last, Func &&body, size_t grain) {
+   const size_t count = range_size(first, last);
+   if (count == 0) {
+      return;
+   }
+   // forked jobs refer to the chunk, so it outlives the group's wait for them
+   auto chunk = [first, &body](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+         body(element(first, i));
+      }
+   };
+   JobGroup group{pool};
+   split_range(group, 0, count, pick_grain(count, group, grain), chunk);
+   group.join();
+}
+
+template<typename It, typename Out, typename Func>
+void parallel_transform(ThreadPool *pool, It first, It last, Out out, Func &&op,
+ size_t grain) {
+   const size_t count = range_size(first, last);
+   if (count == 0) {
+      return;
+   }
+   auto chunk = [first, out, &op](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+         element(out, i) = op(element(first, i));
+      }
+   };
+   JobGroup group{pool};
+   split_range(group, 0, count, pick_grain(count, group, grain), chunk);
+   group.join();
+}
+
+/* a contiguous segment of the range folds into its own partial, and the partials
+are combined in range order once every segment is done */
+template<typename T, typename It, typename Func>
+void reduce_range(JobGroup &group, size_t begin, size_t end, size_t grain, It first,
+ Func &op, std::mutex &lck_partials, std::vector<std::pair<size_t, T>> &partials) {
+   const size_t start = begin;
+   T acc = element(first, begin++);
+   auto fold = [&](size_t stop) {
+      for (; begin < stop; begin++) {
+         acc = op(std::move(acc), element(first, begin));
+      }
+   };
+   while (end - begin > grain) {
+      if (group.starved()) {
+         const size_t mid = begin + (end - begin) / 2;
+         group.fork([&group, mid, end, grain, first, &op, &lck_partials, &partials]() {
+            reduce_range<T>(group, mid, end, grain, first, op, lck_partials, partials);
+         });
+         end = mid;
+      } else {
+         fold(begin + grain);
+      }
+   }
+   fold(end);
+   std::lock_guard locker{lck_partials};
+   partials.emplace_back(start, std::move(acc));
+}
+
+template<typename It, typename T, typename Func>
+T parallel_reduce(ThreadPool *pool, It first, It last, T init, Func &&op, size_t grain) {
+   const size_t count = range_size(first, last);
+   if (count == 0) {
+      return init;
+   }
+   std::mutex lck_partials;
+   std::vector<std::pair<size_t, T>> partials;
+   {
+      JobGroup group{pool};
+      reduce_range<T>(group, 0, count, pick_grain(count, group, grain), first, op,
+         lck_partials, partials);
+      group.join();
+   }
+   std::sort(partials.begin(), partials.end(),
+      [](const auto &a, const auto &b) { return a.first < b.first; });
+   for (auto &partial : partials) {
+      init = op(std::move(init), std::move(partial.second));
+   }
+   return init;
+}
+
+/* two passes over a fixed split of the range into blocks: the total of each block,
+then each block scanned from the combined totals of the blocks before it. every 
+block starts inside the range, the last one may be short */
+template<typename It, typename Out, typename Func>
+void parallel_scan(ThreadPool *pool, It first, It last, Out out, Func &&op) {
+   using T = std::decay_t<decltype(element(first, 0))>;
+   const size_t count = range_size(first, last);
+   if (count == 0) {
+      return;
+   }
+   ThreadPool *const runner = JobGroup::resolve(pool);
+   const size_t threads = (runner != nullptr) ? static_cast<size_t>(runner->size()) : 1;
+   size_t num_blocks = std::min<size_t>(count, threads * 4);
+   const size_t block = (count + num_blocks - 1) / num_blocks;
+   num_blocks = (count + block - 1) / block;
+   std::vector<std::optional<T>> carry(num_blocks);
+   auto totals = [&](size_t begin, size_t end) {
+      for (size_t b = begin; b < end; b++) {
+         const size_t stop = std::min(count, (b + 1) * block);
+         T acc = element(first, b * block);
+         for (size_t i = b * block + 1; i < stop; i++) {
+            acc = op(std::move(acc), element(first, i));
+         }
+         carry[b].emplace(std::move(acc));
+      }
+   };
+   auto scan = [&](size_t begin, size_t end) {
+      for (size_t b = begin; b < end; b++) {
+         const size_t stop = std::min(count, (b + 1) * block);
+         std::optional<T> acc = carry[b];
+         for (size_t i = b * block; i < stop; i++) {
+            acc.emplace(acc ? op(std::move(*acc), element(first, i)) : T(element(first, i)));
+            element(out, i) = *acc;
+         }
+      }
+   };
+   JobGroup group{runner};
+   split_range(group, 0, num_blocks - 1, 1, totals);
+   group.join();
+   // carry[b] becomes the combination of every block before b
+   std::optional<T> running;
+   for (size_t b = 0; b < num_blocks; b++) {
+      std::optional<T> total = std::move(carry[b]);
+      carry[b] = running;
+      if (b + 1 < num_blocks) {
+         running.emplace(running ? op(std::move(*running), std::move(*total)) : std::move(*total));
+      }
+   }
+   split_range(group, 0, num_blocks, 1, scan);
+   group.join();
+}
+
+template<typename It, typename Func>
+void parallel_for(ThreadPool &pool, It first, It last, Func &&body, size_t grain) {
+   parallel_for(&pool, first, last, std::forward<Func>(body), grain);
+}
+
+template<typename It, typename Out, typename Func>
+void parallel_transform(ThreadPool &pool, It first, It last, Out out, Func &&op,
+ size_t grain) {
+   parallel_transform(&pool, first, last, out, std::forward<Func>(op), grain);
+}
+
+template<typename It, typename T, typename Func>
+T parallel_reduce(ThreadPool &pool, It first, It last, T init, Func &&op, size_t grain) {
+   return parallel_reduce(&pool, first, last, std::move(init), std::forward<Func>(op), grain);
+}
+
+template<typename It, typename Out, typename Func>
+void parallel_scan(ThreadPool &pool, It first, It last, Out out, Func &&op) {
+   parallel_scan(&pool, first, last, out, std::forward<Func>(op));
+}
+
+}
+
+#endif
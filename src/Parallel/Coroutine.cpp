@@ -0,0 +1,204 @@
+#include "Coroutine.hpp"
+#include "ThreadPool.hpp"
+
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <vector>
+#include <functional>
+
+namespace Parallel {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/* wakes sleeping frames as their deadlines pass, on a thread started by the first
+Sleep that suspends */
+class Timers {
+   public:
+      Timers() : stopping{false} {}
+      ~Timers() {
+         {
+            std::lock_guard locker{lck};
+            stopping = true;
+         }
+         changed.notify_one();
+         if (thread.joinable()) {
+            thread.join();
+         }
+      }
+
+      void add(const Clock::time_point deadline, CoroutineFrame *frame) {
+         {
+            std::lock_guard locker{lck};
+            if (!thread.joinable()) {
+               thread = std::thread{[this]() { loop(); }};
+            }
+            due.push(Entry{deadline, frame});
+         }
+         changed.notify_one();
+      }
+   private:
+      struct Entry {
+         Clock::time_point deadline;
+         CoroutineFrame *frame;
+         bool operator>(const Entry &other) const { return deadline > other.deadline; }
+      };
+
+      void loop() {
+         std::unique_lock locker{lck};
+         while (!stopping) {
+            if (due.empty()) {
+               changed.wait(locker);
+            } else if (Clock::now() < due.top().deadline) {
+               changed.wait_until(locker, due.top().deadline);
+            } else {
+               CoroutineFrame *frame = due.top().frame;
+               due.pop();
+               locker.unlock();
+               frame->wake();
+               locker.lock();
+            }
+         }
+      }
+
+      std::mutex lck;
+      std::condition_variable changed;
+      std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> due;
+      bool stopping;
+      std::thread thread;
+};
+
+Timers &timers() {
+   static Timers instance;
+   return instance;
+}
+
+}
+
+/* the root's exception goes to the worker running its task, which fails the run.
+a frame awaited by another keeps it for the awaiting frame to rethrow */
+void CoroutineFrame::unhandled_exception() {
+   if (!continuation) {
+      throw;
+   }
+   error = std::current_exception();
+}
+
+/* each park holds the task's place in the run until the matching wake has queued
+the task and its step has finished */
+void CoroutineFrame::park() {
+   if (root->pool != nullptr) {
+      root->node->num_children.fetch_add(1, std::memory_order_relaxed);
+   }
+}
+
+void CoroutineFrame::unpark() {
+   if (root->pool != nullptr) {
+      root->node->num_children.fetch_sub(1, std::memory_order_relaxed);
+   }
+}
+
+/* the frame may be resumed by another thread as soon as its task is queued, so
+nothing of it is touched after */
+void CoroutineFrame::wake() {
+   CoroutineFrame &top = *root;
+   if (top.pool != nullptr) {
+      top.pool->schedule(top.node);
+      return;
+   }
+   try {
+      top.resume();
+   } catch (...) {
+      top.error = std::current_exception();
+      top.finished.store(true, std::memory_order_release);
+      top.finished.notify_all();
+   }
+}
+
+std::coroutine_handle<> CoroutineFrame::finish() noexcept {
+   if (continuation) {
+      root->current = continuation;
+      return continuation;
+   }
+   if (pool == nullptr) {
+      finished.store(true, std::memory_order_release);
+      finished.notify_all();
+   }
+   return std::noop_coroutine();
+}
+
+std::coroutine_handle<> CoroutineFrame::enter(CoroutineFrame &caller,
+ std::coroutine_handle<> resume_to) {
+   root = caller.root;
+   continuation = resume_to;
+   root->current = self;
+   return self;
+}
+
+void CoroutineFrame::rethrow_error() {
+   if (error != nullptr) {
+      std::rethrow_exception(std::exchange(error, nullptr));
+   }
+}
+
+/* on the pool the task holds itself as a subflow's parent does, so that it only
+completes once its step returns and every park has been woken */
+void CoroutineFrame::start(TaskInfo &task) {
+   node = &task;
+   current = self;
+   Worker *worker = (task.topology != nullptr) ? Worker::this_worker() : nullptr;
+   pool = (worker != nullptr) ? worker->employer : nullptr;
+   if (pool != nullptr) {
+      task.num_children.store(1, std::memory_order_relaxed);
+      self.resume();
+      return;
+   }
+   finished.store(false, std::memory_order_relaxed);
+   self.resume();
+   finished.wait(false, std::memory_order_acquire);
+   rethrow_error();
+}
+
+/* a task holding parks was queued by a wake, and resumes rather than restarts */
+bool CoroutineFrame::suspended(const TaskInfo &task) {
+   return task.num_children.load(std::memory_order_relaxed) != 0;
+}
+
+bool Event::Awaiter::suspend(CoroutineFrame &frame) {
+   waiting = &frame;
+   frame.park();
+   void *last = event->state.load(std::memory_order_acquire);
+   do {
+      if (last == event) {
+         frame.unpark();
+         return false; // set meanwhile
+      }
+      next = static_cast<Awaiter*>(last);
+   } while (!event->state.compare_exchange_weak(last, this, std::memory_order_release,
+      std::memory_order_acquire));
+   return true;
+}
+
+Event::Awaiter *Event::release() {
+   void *last = state.exchange(this, std::memory_order_acq_rel);
+   return (last == this) ? nullptr : static_cast<Awaiter*>(last);
+}
+
+/* a woken frame may finish and free its awaiter at once, so the next link is read
+first */
+void Event::wake_all(Awaiter *first) {
+   while (first != nullptr) {
+      Awaiter *next = first->next;
+      first->waiting->wake();
+      first = next;
+   }
+}
+
+void Sleep::suspend(CoroutineFrame &frame) {
+   frame.park();
+   timers().add(deadline, &frame);
+}
+
+}
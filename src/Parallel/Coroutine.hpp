@@ -0,0 +1,254 @@
+#ifndef COROUTINEHPP
+#define COROUTINEHPP
+
+#include <coroutine>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <optional>
+#include <utility>
+#include <type_traits>
+
+namespace Parallel {
+
+struct TaskInfo;
+class ThreadPool;
+class FlowBuilder;
+template<typename Func, typename T>
+struct AsyncProducer;
+
+/* state shared by every coroutine frame, and the protocol its awaiters follow. the
+outermost frame, the root, is run by a graph task. while the root is suspended the
+task keeps its place in the run without holding a worker, and waking the root
+queues the task again, whose worker then resumes the innermost suspended frame.
+off the pool the task's caller blocks instead, and frames resume on the thread
+that wakes them */
+class CoroutineFrame {
+   public:
+      CoroutineFrame() : root{this}, node{nullptr}, pool{nullptr}, finished{false} {}
+      CoroutineFrame(CoroutineFrame&) =delete;
+      CoroutineFrame &operator=(CoroutineFrame&) =delete;
+
+      std::suspend_always initial_suspend() noexcept { return {}; }
+      auto final_suspend() noexcept { return Finish{}; }
+      void unhandled_exception();
+
+      /* an awaiter parks the frame before handing it to whatever will wake it, and
+      unparks it if it then resumes without suspending after all */
+      void park();
+      void unpark();
+
+      /* resumes a parked frame, from any thread, once per park() */
+      void wake();
+
+      /* pool the root's task runs on, null off the pool */
+      ThreadPool *owner() const { return root->pool; }
+   protected:
+      std::coroutine_handle<> self;
+   private:
+      /* hands the thread to the awaiting frame, if any */
+      struct Finish {
+         bool await_ready() const noexcept { return false; }
+         template<typename P>
+         std::coroutine_handle<> await_suspend(std::coroutine_handle<P> done) noexcept {
+            return done.promise().finish();
+         }
+         void await_resume() const noexcept {}
+      };
+
+      std::coroutine_handle<> finish() noexcept;
+
+      /* makes this frame part of the awaiting one's, returns the frame to run */
+      std::coroutine_handle<> enter(CoroutineFrame &caller, std::coroutine_handle<> resume_to);
+      void rethrow_error();
+
+      /* root only, run by the graph task */
+      void start(TaskInfo &task);
+      void resume() { current.resume(); }
+      static bool suspended(const TaskInfo &task);
+
+      CoroutineFrame *root;
+      std::coroutine_handle<> continuation; // frame awaiting this one, none for the root
+      std::coroutine_handle<> current; // root only, the innermost frame to resume
+      TaskInfo *node;
+      ThreadPool *pool; // null when the task runs off the pool
+      std::atomic<bool> finished; // root only, waited on off the pool
+      std::exception_ptr error;
+      template<typename T>
+      friend class Coroutine;
+      friend class FlowBuilder;
+};
+
+template<typename T>
+class FrameValue {
+   public:
+      template<typename U>
+      void return_value(U &&result) { value.emplace(std::forward<U>(result)); }
+   private:
+      std::optional<T> value;
+      template<typename U>
+      friend class Coroutine;
+};
+
+template<>
+class FrameValue<void> {
+   public:
+      void return_void() {}
+};
+
+/* return type of a coroutine run by the graph's workers. a task added with a
+callable returning Coroutine<> may co_await Results, Events, other graphs'
+completion, timers and other Coroutines; each await that cannot complete at once
+suspends the task and frees its worker, and the task is queued on the pool again
+once the awaited thing happens. its successors are released when the coroutine
+returns, and a new frame is made on each run. a cancelled run does not resume a
+suspended task, but still waits for whatever it awaits to wake it */
+template<typename T = void>
+class Coroutine {
+   public:
+      struct promise_type : CoroutineFrame, FrameValue<T> {
+         Coroutine get_return_object() {
+            auto handle = std::coroutine_handle<promise_type>::from_promise(*this);
+            self = handle;
+            return Coroutine{handle};
+         }
+      };
+
+      Coroutine() : handle{nullptr} {}
+      Coroutine(Coroutine &&other) noexcept : handle{std::exchange(other.handle, nullptr)} {}
+      Coroutine &operator=(Coroutine &&other) noexcept {
+         if (&other != this) {
+            reset();
+            handle = std::exchange(other.handle, nullptr);
+         }
+         return *this;
+      }
+      ~Coroutine() { reset(); }
+      Coroutine(const Coroutine&) =delete;
+      Coroutine &operator=(const Coroutine&) =delete;
+
+      /* runs this coroutine as part of the awaiting one, then gives its value or
+      rethrows its exception */
+      auto operator co_await() && { return Awaiter{handle}; }
+   private:
+      struct Awaiter {
+         bool await_ready() const noexcept { return false; }
+         template<typename P>
+         std::coroutine_handle<> await_suspend(std::coroutine_handle<P> caller) {
+            return callee.promise().enter(caller.promise(), caller);
+         }
+         T await_resume() {
+            callee.promise().rethrow_error();
+            if constexpr (!std::is_void_v<T>) {
+               return std::move(*callee.promise().value);
+            }
+         }
+
+         std::coroutine_handle<promise_type> callee;
+      };
+
+      explicit Coroutine(std::coroutine_handle<promise_type> frame) : handle{frame} {}
+
+      void reset() {
+         if (handle) {
+            handle.destroy();
+            handle = nullptr;
+         }
+      }
+
+      /* runs a step of the task: the first starts a new frame, later ones resume it */
+      template<typename Func>
+      void step(TaskInfo &node, Func &make) {
+         if (handle && CoroutineFrame::suspended(node)) {
+            handle.promise().resume();
+            return;
+         }
+         *this = make();
+         handle.promise().start(node);
+      }
+
+      std::coroutine_handle<promise_type> handle;
+      friend class FlowBuilder;
+      template<typename Func, typename U>
+      friend struct AsyncProducer;
+};
+
+/* the value a task's callable gives: a coroutine's is the value it returns */
+template<typename R>
+struct ValueOf { using type = R; };
+template<typename T>
+struct ValueOf<Coroutine<T>> { using type = T; };
+
+template<typename R>
+constexpr bool is_coroutine = false;
+template<typename T>
+constexpr bool is_coroutine<Coroutine<T>> = true;
+
+/* a flag coroutines wait on without holding a thread. set() wakes every waiting
+frame and lets later awaits through until reset() */
+class Event {
+   public:
+      class Awaiter {
+         public:
+            Awaiter(Event &event) : event{&event}, waiting{nullptr}, next{nullptr} {}
+            bool await_ready() const { return event->is_set(); }
+            template<typename P>
+            bool await_suspend(std::coroutine_handle<P> caller) { return suspend(caller.promise()); }
+            void await_resume() const {}
+         private:
+            bool suspend(CoroutineFrame &frame);
+
+            Event *event;
+            CoroutineFrame *waiting;
+            Awaiter *next;
+            friend class Event;
+      };
+
+      explicit Event(const bool set = false) : state{set ? this : nullptr} {}
+      Event(Event&) =delete;
+      Event &operator=(Event&) =delete;
+
+      bool is_set() const { return state.load(std::memory_order_acquire) == this; }
+      void set() { wake_all(release()); }
+      void reset() {
+         void *expected = this;
+         state.compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel,
+            std::memory_order_relaxed);
+      }
+
+      Awaiter operator co_await() { return Awaiter{*this}; }
+   private:
+      /* sets the event and returns its waiters, to be woken once the caller is done
+      with whatever owns the event */
+      Awaiter *release();
+      static void wake_all(Awaiter *first);
+
+      std::atomic<void*> state; // this while set, otherwise the last frame to wait
+      friend class ThreadPool;
+};
+
+/* resumes the awaiting frame once a deadline passes, on a timer thread shared by
+every pool */
+class Sleep {
+   public:
+      Sleep(const std::chrono::steady_clock::time_point at) : deadline{at} {}
+      bool await_ready() const { return std::chrono::steady_clock::now() >= deadline; }
+      template<typename P>
+      void await_suspend(std::coroutine_handle<P> caller) { suspend(caller.promise()); }
+      void await_resume() const {}
+   private:
+      void suspend(CoroutineFrame &frame);
+
+      std::chrono::steady_clock::time_point deadline;
+};
+
+/* co_await after(delay) suspends the coroutine for at least delay */
+template<typename Rep, typename Period>
+Sleep after(const std::chrono::duration<Rep, Period> delay) {
+   return Sleep{std::chrono::steady_clock::now() +
+      std::chrono::ceil<std::chrono::steady_clock::duration>(delay)};
+}
+
+}
+
+#endif
@@ -2,6 +2,7 @@
 #define PARRERRORSHPP
 
 #include <stdexcept>
+#include <string>
 
 namespace Parallel {
 
@@ -12,6 +13,20 @@ struct cache_error : public std::logic_error {
       const char *what() const noexcept { return whatmessage; }
 };
 
+/* thrown when a graph is compiled with a dependency cycle, the message lists the
+tasks along one such cycle */
+struct cycle_error : public std::logic_error {
+   public:
+      cycle_error(const std::string &message) : std::logic_error{message} {}
+};
+
+/* held by the result or future of a task that was skipped because its run was 
+cancelled */
+struct cancelled_error : public std::runtime_error {
+   public:
+      cancelled_error(const std::string &message) : std::runtime_error{message} {}
+};
+
 }
 
 #endif
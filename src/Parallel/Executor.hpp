@@ -2,85 +2,245 @@
 #define EXECUTORHPP
 
 #include <new>
-#include <array>
+#include <cstddef>
 #include <utility>
 #include <type_traits>
 
+/* bytes of closure state stored inside an Executor before spilling to the heap */
+#ifndef PARALLEL_EXECUTOR_INLINE_SIZE
+#define PARALLEL_EXECUTOR_INLINE_SIZE 112
+#endif
+
 namespace Parallel {
 
-class alignas(64) Executor {
+/* per-thread free lists of closure blocks, in power-of-two size classes from 64
+bytes to 4KiB. a block freed on a thread is cached for reuse by that thread, up to
+a limit per class; larger requests go straight to operator new */
+class ClosurePool {
+   public:
+      static constexpr size_t min_block = 64;
+      static constexpr size_t max_block = 4096;
+      static constexpr size_t alignment = 64;
+
+      static void *allocate(size_t size) {
+         if (size > max_block) {
+            return ::operator new(size, std::align_val_t{alignment});
+         }
+         const int index = size_class(size);
+         Cache &cache = local();
+         FreeBlock *block = cache.heads[index];
+         if (block != nullptr) {
+            cache.heads[index] = block->next;
+            cache.counts[index]--;
+            return block;
+         }
+         return ::operator new(min_block << index, std::align_val_t{alignment});
+      }
+
+      static void deallocate(void *ptr, size_t size) noexcept {
+         if (size > max_block) {
+            ::operator delete(ptr, std::align_val_t{alignment});
+            return;
+         }
+         const int index = size_class(size);
+         Cache &cache = local();
+         if (cache.counts[index] >= max_cached) {
+            ::operator delete(ptr, std::align_val_t{alignment});
+            return;
+         }
+         FreeBlock *block = static_cast<FreeBlock*>(ptr);
+         block->next = cache.heads[index];
+         cache.heads[index] = block;
+         cache.counts[index]++;
+      }
+   private:
+      static constexpr int num_classes = 7;
+      static constexpr int max_cached = 256;
+
+      struct FreeBlock {
+         FreeBlock *next;
+      };
+
+      struct Cache {
+         Cache() : heads{}, counts{} {}
+         ~Cache() {
+            for (auto *head : heads) {
+               while (head != nullptr) {
+                  FreeBlock *next = head->next;
+                  ::operator delete(head, std::align_val_t{alignment});
+                  head = next;
+               }
+            }
+         }
+         FreeBlock *heads[num_classes];
+         int counts[num_classes];
+      };
+
+      static int size_class(size_t size) noexcept {
+         int index = 0;
+         for (size_t block = min_block; block < size; block <<= 1) {
+            index++;
+         }
+         return index;
+      }
+
+      static Cache &local() {
+         thread_local Cache cache;
+         return cache;
+      }
+};
+
+/* type-erased, move-only nullary callable. a callable that fits in InlineSize bytes,
+is no more aligned than the Executor and moves without throwing is stored inline;
+anything else is placed in a ClosurePool block. calls, moves and destruction go
+through a static table of functions per callable type rather than a vtable held
+in the stored object */
+template<size_t InlineSize>
+class alignas(64) BasicExecutor {
+   static_assert(InlineSize >= sizeof(void*), "inline storage must hold a pointer");
    public:
-      Executor() { sbstore.fill(0); }
-      Executor(Executor &&other) noexcept {
-         sbstore = std::move(other.sbstore);
-         other.sbstore.fill(0);
+      static constexpr size_t inline_size = InlineSize;
+
+      BasicExecutor() noexcept : ops{nullptr} {}
+      ~BasicExecutor() { reset(); }
+
+      BasicExecutor(BasicExecutor &&other) noexcept : ops{other.ops} {
+         if (ops != nullptr) {
+            ops->relocate(data(), other.data());
+            other.ops = nullptr;
+         }
       }
 
-      Executor &operator=(Executor &&other) noexcept {
-         sbstore = std::move(other.sbstore);
-         other.sbstore.fill(0);
+      BasicExecutor &operator=(BasicExecutor &&other) noexcept {
+         if (&other != this) {
+            reset();
+            ops = other.ops;
+            if (ops != nullptr) {
+               ops->relocate(data(), other.data());
+               other.ops = nullptr;
+            }
+         }
          return *this;
       }
-      
+
+      template<typename Func>
+      static BasicExecutor make_closure(Func &&callable);
+
+      /* replaces the stored callable with a Func built from args and returns it. the
+      reference is valid until the Executor is moved from, reset or destroyed */
+      template<typename Func, typename... Args>
+      Func &emplace(Args&&... args);
+
+      /* true if callables of this type are stored without a heap block */
       template<typename Func>
-      static Executor make_closure(Func &&callable);
+      static constexpr bool stored_inline = sizeof(Func) <= InlineSize
+         && alignof(Func) <= 64 && std::is_nothrow_move_constructible_v<Func>;
+
+      void operator()() {
+         ops->invoke(data());
+      }
 
-      void operator()() { 
-         get_task().execute();
+      explicit operator bool() const noexcept { return ops != nullptr; }
+
+      /* destroys the stored callable, if any */
+      void reset() noexcept {
+         if (ops != nullptr) {
+            ops->destroy(data());
+            ops = nullptr;
+         }
       }
    private:
-      struct TaskBase {
-         TaskBase() {}
-         TaskBase(const TaskBase&) =delete;
-         TaskBase &operator=(const TaskBase&) =delete;
-         virtual ~TaskBase() {}
-         virtual void execute() =0;
+      struct Ops {
+         void (*invoke)(void*);
+         void (*relocate)(void*, void*) noexcept;
+         void (*destroy)(void*) noexcept;
       };
 
       template<typename Func>
-      struct Closure final : public TaskBase {
-         Closure() {}
-         ~Closure() {}
-         Closure(Func &&f) : task{std::forward<Func>(f)} {}
-         Closure(const Closure&) =delete;
-         Closure &operator=(const Closure&) =delete;
-         Closure(Closure &&t) noexcept : task{std::move(t.task)} {}
-         Closure &operator=(Closure &&t) noexcept { 
-            task = std::move(t.task); 
-            return *this; 
-         }
-         void execute() override final { 
-            task(); 
+      struct InlineOps {
+         static Func &get(void *store) { return *std::launder(static_cast<Func*>(store)); }
+         static void invoke(void *store) { get(store)(); }
+         static void relocate(void *dest, void *src) noexcept {
+            new(dest) Func(std::move(get(src)));
+            get(src).~Func();
          }
+         static void destroy(void *store) noexcept { get(store).~Func(); }
+         static constexpr Ops table{&invoke, &relocate, &destroy};
+      };
 
-         Func task;
+      template<typename Func>
+      struct HeapOps {
+         static Func *&get(void *store) { return *std::launder(static_cast<Func**>(store)); }
+         static void invoke(void *store) { (*get(store))(); }
+         static void relocate(void *dest, void *src) noexcept {
+            new(dest) Func*{get(src)};
+         }
+         static void destroy(void *store) noexcept {
+            Func *callable = get(store);
+            callable->~Func();
+            if constexpr (alignof(Func) > ClosurePool::alignment) {
+               ::operator delete(callable, std::align_val_t{alignof(Func)});
+            } else {
+               ClosurePool::deallocate(callable, sizeof(Func));
+            }
+         }
+         static constexpr Ops table{&invoke, &relocate, &destroy};
       };
-      using Storage = std::array<unsigned long, 16>;
-   private: 
-      Executor(const Executor&) =delete;
-      Executor &operator=(const Executor&) =delete;
-
-      void *data()                     { return static_cast<void*>(sbstore.data()); }
-      const void *data() const         { return static_cast<const void*>(sbstore.data()); }
-      TaskBase &get_task()             { return *static_cast<TaskBase*>(data()); }
-      const TaskBase &get_task() const { return *static_cast<const TaskBase*>(data()); }
+
+      BasicExecutor(const BasicExecutor&) =delete;
+      BasicExecutor &operator=(const BasicExecutor&) =delete;
+
+      void *data()                     { return static_cast<void*>(storage); }
+      const void *data() const         { return static_cast<const void*>(storage); }
    private:
-      Storage sbstore;
+      alignas(64) unsigned char storage[InlineSize];
+      const Ops *ops;
 };
 
+using Executor = BasicExecutor<PARALLEL_EXECUTOR_INLINE_SIZE>;
+
 /* Implementation */
 
+template<size_t InlineSize>
 template<typename Func>
-Executor Executor::make_closure(Func &&callable) {
-   static_assert(alignof(callable) <= alignof(Executor), 
-      "alignment of callable must not exceed that of Executor class");
-   static_assert(sizeof(callable) <= sizeof(sbstore), 
-      "size of callable may not exceed 64 bytes");
-   Executor init{};
-   new(init.sbstore.data()) Closure<Func>{std::forward<Func>(callable)};
-   return std::move(init);
+BasicExecutor<InlineSize> BasicExecutor<InlineSize>::make_closure(Func &&callable) {
+   BasicExecutor init{};
+   init.template emplace<std::decay_t<Func>>(std::forward<Func>(callable));
+   return init;
+}
+
+template<size_t InlineSize>
+template<typename Func, typename... Args>
+Func &BasicExecutor<InlineSize>::emplace(Args&&... args) {
+   reset();
+   if constexpr (stored_inline<Func>) {
+      Func *callable = new(data()) Func(std::forward<Args>(args)...);
+      ops = &InlineOps<Func>::table;
+      return *callable;
+   } else {
+      void *block = nullptr;
+      if constexpr (alignof(Func) > ClosurePool::alignment) {
+         block = ::operator new(sizeof(Func), std::align_val_t{alignof(Func)});
+      } else {
+         block = ClosurePool::allocate(sizeof(Func));
+      }
+      Func *callable = nullptr;
+      try {
+         callable = new(block) Func(std::forward<Args>(args)...);
+      } catch (...) {
+         if constexpr (alignof(Func) > ClosurePool::alignment) {
+            ::operator delete(block, std::align_val_t{alignof(Func)});
+         } else {
+            ClosurePool::deallocate(block, sizeof(Func));
+         }
+         throw;
+      }
+      new(data()) Func*{callable};
+      ops = &HeapOps<Func>::table;
+      return *callable;
+   }
 }
 
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,110 @@
+#include "FlowBuilder.hpp"
+#include "ThreadPool.hpp"
+#include "Scheduler.hpp"
+
+namespace Parallel {
+
+std::pair<Task, Result<size_t>> FlowBuilder::read(const int fd, void *buffer, 
+ const size_t size, const int64_t offset) {
+   return add([fd, buffer, size, offset]() -> Coroutine<size_t> {
+      co_return co_await async_read(fd, buffer, size, offset);
+   });
+}
+
+std::pair<Task, Result<size_t>> FlowBuilder::write(const int fd, const void *buffer, 
+ const size_t size, const int64_t offset) {
+   return add([fd, buffer, size, offset]() -> Coroutine<size_t> {
+      co_return co_await async_write(fd, buffer, size, offset);
+   });
+}
+
+Task FlowBuilder::fsync(const int fd) {
+   return silent_add([fd]() -> Coroutine<> {
+      co_await async_fsync(fd);
+   });
+}
+
+Task FlowBuilder::module(Scheduler &graph) {
+   TaskInfo &node = vertices.emplace();
+   node.exec = Executor::make_closure(
+      [&graph, &node, frame = Coroutine<>{}]() mutable {
+         auto run = [&graph, &node]() { return graph.embed(node); };
+         frame.step(node, run);
+      }
+   );
+   changed = true;
+   return Task{node};
+}
+
+Subflow::Subflow(TaskInfo &parent) :
+ FlowBuilder{children_of(parent)}, parent{parent}, 
+ worker{(parent.topology != nullptr) ? Worker::this_worker() : nullptr} {
+   if (worker != nullptr) {
+      // held by the parent until it returns, so children cannot complete it early
+      parent.num_children.store(1, std::memory_order_relaxed);
+   }
+}
+
+/* the children's timings are totalled before they are cleared, if the pool is
+timing tasks, so the report can put them in place of the parent's wait */
+void Subflow::join() {
+   if (vertices.empty()) {
+      return;
+   }
+   const uint64_t started = clock_ns();
+   spawn();
+   if (worker != nullptr) {
+      worker->corun(parent.num_children, 1);
+      if (worker->timed()) {
+         const RunReport children = analyze(vertices.sorted(), 0, 0);
+         JoinedTime &joined = vertices.joined();
+         joined.wait_ns += clock_ns() - started;
+         joined.work_ns += children.work_ns;
+         joined.span_ns += children.span_ns;
+      }
+   }
+   vertices.clear();
+}
+
+void Subflow::finish() {
+   if (!vertices.empty()) {
+      spawn();
+   }
+}
+
+/* off the pool the children are run on the calling thread in dependency order */
+void Subflow::spawn() {
+   vertices.seal();
+   const auto &order = vertices.sort();
+   changed = false;
+   if (worker == nullptr) {
+      for (auto *child : order) {
+         (*child)();
+      }
+      return;
+   }
+   parent.num_children.fetch_add(static_cast<int>(vertices.size()), std::memory_order_relaxed);
+   for (auto &child : vertices) {
+      child.topology = parent.topology;
+      child.parent = &parent;
+      child.priority = parent.priority;
+   }
+   for (auto *child : order) {
+      if (child->join_count != 0) {
+         break;
+      }
+      worker->submit(child);
+   }
+}
+
+Graph &Subflow::children_of(TaskInfo &parent) {
+   if (parent.subgraph == nullptr) {
+      parent.subgraph.reset(new Graph{});
+   } else {
+      parent.subgraph->clear();
+      parent.subgraph->joined() = JoinedTime{};
+   }
+   return *parent.subgraph;
+}
+
+}
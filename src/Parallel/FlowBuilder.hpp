@@ -0,0 +1,331 @@
+#ifndef FLOWBUILDERHPP
+#define FLOWBUILDERHPP
+
+#include <future>
+#include <utility>
+#include <tuple>
+#include <type_traits>
+
+#include "Task.hpp"
+#include "Graph.hpp"
+#include "Result.hpp"
+#include "Coroutine.hpp"
+#include "IoService.hpp"
+#include "Algorithms.hpp"
+
+namespace Parallel {
+
+class Worker;
+class Subflow;
+class Scheduler;
+
+/* adds tasks and dependencies to a graph it does not own. shared by Scheduler, 
+which builds the graph before running it, and Subflow, which builds one from 
+inside a running task */
+class FlowBuilder {
+   public:
+      FlowBuilder(Graph &graph) : vertices{graph}, changed{true} {}
+      FlowBuilder(FlowBuilder&) =delete;
+      FlowBuilder &operator=(FlowBuilder&) =delete;
+
+      /* adds a void-returning task to the graph, returns a handle to the task. 
+      arguments are copied into the task, except Results, which make the task depend 
+      on their producer and receive its value by move on each run. a value that feeds
+      several tasks should be taken by const reference in all of them. a task 
+      invocable with a Subflow& is given one each time it runs, and a task 
+      returning Coroutine<> runs as a coroutine, see Coroutine */
+      template<typename Func>
+      Task silent_add(Func &&task);
+      template<typename Func, typename... Args>
+      Task silent_add(Func &&task, Args&&... args);
+
+      /* adds a non-void returning task to the graph, returns a handle to the task 
+      and to its result, which is stored in the task itself. a task returning 
+      Coroutine<T> runs as a coroutine and its result is the T it returns */
+      template<typename Func>
+      auto add(Func &&task) 
+         -> std::pair<Task, Result<typename ValueOf<decltype(task())>::type>>;
+      template<typename Func, typename... Args>
+      auto add(Func &&task, Args&&... args)
+         -> std::pair<Task, Result<typename ValueOf<ReturnOf<Func, Args...>>::type>>;
+
+      /* as add, but the result is delivered through a std::future. only the first 
+      run's value, or the exception it threw, reaches the future; if that run was
+      cancelled before the task started the future holds a cancelled_error */
+      template<typename Func, typename... Args>
+      auto add_future(Func &&task, Args&&... args)
+         -> std::pair<Task, std::future<ReturnOf<Func, Args...>>>;
+
+      /* add tasks that read or write size bytes of a file descriptor at offset, -1
+      being the file's position, or that sync it, through the pool's IoService. the
+      worker is free while the request is in flight. the result holds the number
+      of bytes transferred, or the std::system_error of a failed call */
+      std::pair<Task, Result<size_t>> read(const int fd, void *buffer, const size_t size, 
+         const int64_t offset = -1);
+      std::pair<Task, Result<size_t>> write(const int fd, const void *buffer, 
+         const size_t size, const int64_t offset = -1);
+      Task fsync(const int fd);
+
+      /* adds a module task, which runs graph once in place on the pool running this
+      graph. the graph's sources are queued when the task becomes ready, and the 
+      task completes once every task of the graph has, without holding a worker 
+      meanwhile. the graph is referenced rather than copied, so it may be a module of
+      several graphs, but only one of its runs may be in progress at a time. the 
+      module task rethrows an exception thrown by the graph's tasks */
+      Task module(Scheduler &graph);
+
+      /* creates separate dependencies from root to all listed targets */
+      template<typename... T>
+      void direct(Task &root, T&... targets);
+
+      /* creates linear dependencies from root to last target listed */
+      template<typename T>
+      void linearize(Task &root, T &last);
+      template<typename T, typename... Tp>
+      void linearize(Task &root, T &first, Tp&... rest);
+
+      /* add a task running the parallel algorithm of the same name over the range, 
+      split across the pool that runs the graph */
+      template<typename It, typename Func>
+      Task parallel_for(It first, It last, Func &&body, size_t grain = 0);
+      template<typename It, typename Out, typename Func>
+      Task parallel_transform(It first, It last, Out out, Func &&op, size_t grain = 0);
+      template<typename It, typename T, typename Func>
+      std::pair<Task, Result<T>> parallel_reduce(It first, It last, T init, Func &&op, 
+         size_t grain = 0);
+      template<typename It, typename Out, typename Func>
+      Task parallel_scan(It first, It last, Out out, Func &&op);
+   protected:
+      /* binds arguments to a callable, the arguments are stored in the closure */
+      template<typename Func, typename... Args>
+      static auto bind(Func &&task, Args&&... args);
+
+      /* stores the closure of a value-returning task in node, returns its slot */
+      template<typename Closure, typename RetType, typename F>
+      static auto &produce(TaskInfo &node, F &&task);
+
+      /* makes node depend on the producer of each Result among args */
+      template<typename... Args>
+      void wire(TaskInfo &node, const Args&... args);
+
+      Graph &vertices;
+      bool changed; // set when tasks or edges are added
+};
+
+/* handed to a task added with a callable taking a Subflow&, whose tasks become the
+running task's children. children are queued on the running worker once the task 
+returns, or earlier by join(), and the task's successors are released only after 
+every child has finished. the children are rebuilt on every run of the task */
+class Subflow : public FlowBuilder {
+   public:
+      Subflow(TaskInfo &parent);
+      Subflow(Subflow&) =delete;
+      Subflow &operator=(Subflow&) =delete;
+
+      /* queues the children added so far and blocks until they finish, the calling
+      worker runs queued tasks while it waits. more children may be added after */
+      void join();
+   private:
+      /* queues the children added so far without waiting for them */
+      void spawn();
+
+      /* called once the task returns */
+      void finish();
+
+      static Graph &children_of(TaskInfo &parent);
+
+      TaskInfo &parent;
+      Worker *worker; // null when the task was called outside a pool
+      friend class FlowBuilder;
+};
+
+/* Implementation */
+
+template<typename Func>
+Task FlowBuilder::silent_add(Func &&task) {
+   if constexpr (std::is_invocable_v<std::decay_t<Func>&, Subflow&>) {
+      TaskInfo &node = vertices.emplace();
+      node.exec = Executor::make_closure(
+         [task = std::forward<Func>(task), &node]() mutable {
+            Subflow flow{node};
+            task(flow);
+            flow.finish();
+         }
+      );
+      changed = true;
+      return Task{node};
+   } else if constexpr (is_coroutine<std::invoke_result_t<std::decay_t<Func>&>>) {
+      static_assert(std::is_same_v<std::invoke_result_t<std::decay_t<Func>&>, Coroutine<>>,
+         "a coroutine task returns Coroutine<>, values are passed with add()");
+      TaskInfo &node = vertices.emplace();
+      node.exec = Executor::make_closure(
+         [task = std::forward<Func>(task), &node, frame = Coroutine<>{}]() mutable {
+            frame.step(node, task);
+         }
+      );
+      changed = true;
+      return Task{node};
+   } else {
+      TaskInfo &node = vertices.emplace(Executor::make_closure(std::forward<Func>(task)));
+      changed = true;
+      return Task{node};
+   }
+}
+
+template<typename Func, typename... Args>
+Task FlowBuilder::silent_add(Func &&task, Args&&... args) {
+   TaskInfo &node = vertices.emplace();
+   wire(node, args...);
+   node.exec = Executor::make_closure(bind(std::forward<Func>(task), std::forward<Args>(args)...));
+   changed = true;
+   return Task{node};
+}
+
+template<typename Func>
+auto FlowBuilder::add(Func &&task) 
+-> std::pair<Task, Result<typename ValueOf<decltype(task())>::type>> {
+   using RetType = decltype(task());
+   using ValueType = typename ValueOf<RetType>::type;
+   static_assert(!std::is_void_v<ValueType>, "void-returning tasks are added with silent_add");
+   TaskInfo &node = vertices.emplace();
+   auto &slot = produce<std::decay_t<Func>, RetType>(node, std::forward<Func>(task));
+   node.sees_cancel = true;
+   changed = true;
+   return std::make_pair(Task{node}, Result<ValueType>{slot, node});
+}
+
+template<typename Func, typename... Args>
+auto FlowBuilder::add(Func &&task, Args&&... args) 
+-> std::pair<Task, Result<typename ValueOf<ReturnOf<Func, Args...>>::type>> {
+   using RetType = ReturnOf<Func, Args...>;
+   using ValueType = typename ValueOf<RetType>::type;
+   static_assert(!std::is_void_v<ValueType>, "void-returning tasks are added with silent_add");
+   using Closure = Bound<std::decay_t<Func>, std::decay_t<Args>...>;
+   TaskInfo &node = vertices.emplace();
+   wire(node, args...);
+   auto &slot = produce<Closure, RetType>(node, 
+      bind(std::forward<Func>(task), std::forward<Args>(args)...));
+   node.sees_cancel = true;
+   changed = true;
+   return std::make_pair(Task{node}, Result<ValueType>{slot, node});
+}
+
+template<typename Func, typename... Args>
+auto FlowBuilder::add_future(Func &&task, Args&&... args)
+-> std::pair<Task, std::future<ReturnOf<Func, Args...>>> {
+   using RetType = ReturnOf<Func, Args...>;
+   std::promise<RetType> ret_promise;
+   std::future<RetType> ret = ret_promise.get_future();
+   TaskInfo &node = vertices.emplace();
+   wire(node, args...);
+   node.exec = Executor::make_closure(
+      [ret_promise = std::move(ret_promise), fulfilled = false,
+      call = bind(std::forward<Func>(task), std::forward<Args>(args)...)]() mutable {
+         if (fulfilled) {
+            if (!run_cancelled()) {
+               call();
+            }
+            return;
+         }
+         fulfilled = true;
+         if (run_cancelled()) {
+            ret_promise.set_exception(std::make_exception_ptr(cancelled_error{"task was cancelled"}));
+            return;
+         }
+         try {
+            ret_promise.set_value(call());
+         } catch (...) {
+            ret_promise.set_exception(std::current_exception());
+            throw;
+         }
+      }
+   ); 
+   node.sees_cancel = true;
+   changed = true;
+   return std::make_pair(Task{node}, std::move(ret));
+}
+
+template<typename Func, typename... Args>
+auto FlowBuilder::bind(Func &&task, Args&&... args) {
+   return Bound<std::decay_t<Func>, std::decay_t<Args>...>{
+      std::forward<Func>(task), std::forward<Args>(args)...};
+}
+
+template<typename Closure, typename RetType, typename F>
+auto &FlowBuilder::produce(TaskInfo &node, F &&task) {
+   if constexpr (is_coroutine<RetType>) {
+      using ValueType = typename ValueOf<RetType>::type;
+      return node.exec.emplace<AsyncProducer<Closure, ValueType>>(std::forward<F>(task), 
+         node).slot;
+   } else {
+      return node.exec.emplace<Producer<Closure, RetType>>(std::forward<F>(task)).slot;
+   }
+}
+
+template<typename... Args>
+void FlowBuilder::wire(TaskInfo &node, const Args&... args) {
+   if constexpr (sizeof...(Args) > 0) {
+      auto wire_one = [this, &node](const auto &arg) {
+         if constexpr (is_result<std::decay_t<decltype(arg)>>) {
+            vertices.connect(arg.producer, &node);
+         }
+      };
+      (wire_one(args), ...);
+   }
+}
+
+template<typename... T>
+void FlowBuilder::direct(Task &root, T&... targets) {
+   static_assert(sizeof...(targets) > 0, "root must direct targets");
+   static_assert((std::is_same_v<Task, T> && ...), "only Tasks may direct");
+   (vertices.connect(root.node, targets.node), ...);
+   changed = true;
+}
+
+template<typename T>
+void FlowBuilder::linearize(Task &root, T &last) {
+   static_assert(std::is_same_v<Task, T>, "only Tasks may linearize");
+   vertices.connect(root.node, last.node);
+   changed = true;
+}
+
+template<typename T, typename... Tp>
+void FlowBuilder::linearize(Task &root, T &first, Tp&... rest) {
+   static_assert(std::is_same_v<Task, T> && (std::is_same_v<Task, Tp> && ...), 
+      "only Tasks may linearize");
+   vertices.connect(root.node, first.node);
+   linearize(first, rest...);
+}
+
+template<typename It, typename Func>
+Task FlowBuilder::parallel_for(It first, It last, Func &&body, size_t grain) {
+   return silent_add([first, last, body = std::forward<Func>(body), grain]() mutable {
+      Parallel::parallel_for(static_cast<ThreadPool*>(nullptr), first, last, body, grain);
+   });
+}
+
+template<typename It, typename Out, typename Func>
+Task FlowBuilder::parallel_transform(It first, It last, Out out, Func &&op, size_t grain) {
+   return silent_add([first, last, out, op = std::forward<Func>(op), grain]() mutable {
+      Parallel::parallel_transform(static_cast<ThreadPool*>(nullptr), first, last, out, op, grain);
+   });
+}
+
+template<typename It, typename T, typename Func>
+std::pair<Task, Result<T>> FlowBuilder::parallel_reduce(It first, It last, T init, Func &&op, 
+ size_t grain) {
+   return add([first, last, init = std::move(init), op = std::forward<Func>(op), grain]() mutable {
+      return Parallel::parallel_reduce(static_cast<ThreadPool*>(nullptr), first, last, init, op, grain);
+   });
+}
+
+template<typename It, typename Out, typename Func>
+Task FlowBuilder::parallel_scan(It first, It last, Out out, Func &&op) {
+   return silent_add([first, last, out, op = std::forward<Func>(op)]() mutable {
+      Parallel::parallel_scan(static_cast<ThreadPool*>(nullptr), first, last, out, op);
+   });
+}
+
+}
+
+#endif
@@ -0,0 +1,157 @@
+#include "Graph.hpp"
+
+#include <algorithm>
+
+namespace Parallel {
+
+void GraphDeleter::operator()(Graph *graph) const {
+   delete graph;
+}
+
+void NodeArena::clear() {
+   for (size_t i = 0; i < count; i++) {
+      (*this)[i].~TaskInfo();
+   }
+   count = 0;
+}
+
+/* counting sort of the edges by source, then each node's span is deduplicated
+in place, keeping declaration order. a condition task's span is kept as declared */
+void Graph::seal() {
+   const size_t num_nodes = arena.size();
+   offsets.assign(num_nodes + 1, 0);
+   for (auto &edge : edges) {
+      offsets[edge.first->id + 1]++;
+   }
+   for (size_t i = 0; i < num_nodes; i++) {
+      offsets[i + 1] += offsets[i];
+   }
+   successors.resize(edges.size());
+   {
+      std::vector<size_t> cursor{offsets.begin(), offsets.end() - 1};
+      for (auto &edge : edges) {
+         successors[cursor[edge.first->id]++] = edge.second;
+      }
+   }
+   for (auto &node : arena) {
+      node.join_count = 0;
+   }
+   // a successor is kept the first time it appears in a node's span
+   std::vector<size_t> seen_by(num_nodes, num_nodes);
+   size_t write = 0;
+   for (size_t i = 0; i < num_nodes; i++) {
+      const size_t first = offsets[i];
+      const size_t last = offsets[i + 1];
+      offsets[i] = write;
+      if (arena[i].condition) {
+         for (size_t j = first; j < last; j++) {
+            successors[write++] = successors[j];
+         }
+         continue;
+      }
+      for (size_t j = first; j < last; j++) {
+         TaskInfo *dep = successors[j];
+         if (seen_by[dep->id] != i) {
+            seen_by[dep->id] = i;
+            dep->join_count++;
+            successors[write++] = dep;
+         }
+      }
+   }
+   offsets[num_nodes] = write;
+   successors.resize(write);
+   TaskInfo **base = successors.data();
+   for (size_t i = 0; i < num_nodes; i++) {
+      TaskInfo &node = arena[i];
+      node.dests = Successors{base + offsets[i], base + offsets[i + 1]};
+      node.num_deps.store(node.join_count, std::memory_order_relaxed);
+   }
+}
+
+/* Kahn's algorithm, the order doubles as the work queue */
+const std::vector<TaskInfo*> &Graph::sort() {
+   order.clear();
+   order.reserve(arena.size());
+   pending.resize(arena.size());
+   for (auto &node : arena) {
+      node.depth = 0;
+      pending[node.id] = node.join_count;
+      if (node.join_count == 0) {
+         order.push_back(&node);
+      }
+   }
+   for (size_t head = 0; head < order.size(); head++) {
+      TaskInfo *node = order[head];
+      if (node->condition) {
+         continue;
+      }
+      for (auto *dep : node->dests) {
+         dep->depth = std::max(dep->depth, node->depth + 1);
+         if (--pending[dep->id] == 0) {
+            order.push_back(dep);
+         }
+      }
+   }
+   if (order.size() != arena.size()) {
+      throw cycle_error{"task dependencies must be acyclic, found cycle " + describe_cycle()};
+   }
+   return order;
+}
+
+/* depth-first search, without recursion, over the nodes sort() could not order. 
+every one of them is on or downstream of a cycle, so the search finds a back edge */
+std::string Graph::describe_cycle() {
+   enum Mark : char { unseen, open, closed };
+   std::vector<char> marks(arena.size(), unseen);
+   std::vector<std::pair<TaskInfo*, TaskInfo**>> path;
+   auto label = [](TaskInfo *node) {
+      return node->mname.empty() ? "#" + std::to_string(node->id) : node->mname;
+   };
+   // weak edges cannot be part of the cycle
+   auto first_dep = [](TaskInfo *node) {
+      return node->condition ? node->dests.end() : node->dests.begin();
+   };
+   for (auto &root : arena) {
+      if (pending[root.id] == 0 || marks[root.id] != unseen) {
+         continue;
+      }
+      marks[root.id] = open;
+      path.emplace_back(&root, first_dep(&root));
+      while (!path.empty()) {
+         auto &[node, next] = path.back();
+         if (next == node->dests.end()) {
+            marks[node->id] = closed;
+            path.pop_back();
+            continue;
+         }
+         TaskInfo *dep = *next++;
+         if (pending[dep->id] == 0 || marks[dep->id] == closed) {
+            continue;
+         }
+         if (marks[dep->id] == open) {
+            std::string cycle;
+            auto iter = path.begin();
+            while (iter->first != dep) {
+               ++iter;
+            }
+            for (; iter != path.end(); ++iter) {
+               cycle += label(iter->first) + " -> ";
+            }
+            return cycle + label(dep);
+         }
+         marks[dep->id] = open;
+         path.emplace_back(dep, first_dep(dep));
+      }
+   }
+   return "";
+}
+
+void Graph::clear() {
+   arena.clear();
+   edges.clear();
+   successors.clear();
+   offsets.clear();
+   order.clear();
+}
+
+}
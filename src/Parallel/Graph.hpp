@@ -0,0 +1,139 @@
+#ifndef GRAPHHPP
+#define GRAPHHPP
+
+#include <vector>
+#include <memory>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "Task.hpp"
+#include "Errors.hpp"
+
+namespace Parallel {
+
+/* storage for task nodes, constructed in place in fixed-size contiguous blocks 
+so that nodes never move as the graph grows. clear() destroys the nodes but keeps 
+the blocks for reuse */
+class NodeArena {
+   public:
+      static constexpr size_t block_size = 256;
+
+      class iterator {
+         public:
+            iterator(NodeArena *arena, size_t index) : arena{arena}, index{index} {}
+            TaskInfo &operator*() const { return (*arena)[index]; }
+            TaskInfo *operator->() const { return &(*arena)[index]; }
+            iterator &operator++() { index++; return *this; }
+            bool operator==(const iterator &other) const { return index == other.index; }
+            bool operator!=(const iterator &other) const { return index != other.index; }
+         private:
+            NodeArena *arena;
+            size_t index;
+      };
+
+      NodeArena() : count{0} {}
+      ~NodeArena() { clear(); }
+      NodeArena(NodeArena&) =delete;
+      NodeArena &operator=(NodeArena&) =delete;
+
+      template<typename... Args>
+      TaskInfo &emplace(Args&&... args);
+
+      TaskInfo &operator[](size_t index) {
+         return blocks[index / block_size]->nodes()[index % block_size];
+      }
+
+      iterator begin() { return iterator{this, 0}; }
+      iterator end() { return iterator{this, count}; }
+      size_t size() const { return count; }
+      bool empty() const { return count == 0; }
+      void clear();
+   private:
+      struct Block {
+         TaskInfo *nodes() { return reinterpret_cast<TaskInfo*>(bytes); }
+         alignas(TaskInfo) unsigned char bytes[sizeof(TaskInfo) * block_size];
+      };
+
+      std::vector<std::unique_ptr<Block>> blocks;
+      size_t count;
+};
+
+/* children a subflow joined and then cleared during its task's run, totalled so the
+run's report still counts them. wait is the time the task spent in join() */
+struct JoinedTime {
+   uint64_t wait_ns = 0;
+   uint64_t work_ns = 0;
+   uint64_t span_ns = 0;
+};
+
+/* nodes and edges of a task graph. edges are collected as they are declared and
+frozen by seal() into one compressed sparse row array, each node's successors 
+being a contiguous span of it. the edges of a condition task are weak: they are 
+not dependencies and may close loops, and its successors keep the order and 
+repeats they were declared with, since the task picks one by position */
+class Graph {
+   public:
+      Graph() {}
+      Graph(Graph&) =delete;
+      Graph &operator=(Graph&) =delete;
+
+      template<typename... Args>
+      TaskInfo &emplace(Args&&... args) { return arena.emplace(std::forward<Args>(args)...); }
+
+      /* declares that to depends on from, repeated edges are merged by seal() */
+      void connect(TaskInfo *from, TaskInfo *to) { edges.emplace_back(from, to); }
+
+      /* builds the successor spans and dependency counts of every node, weak edges
+      being left out of the counts */
+      void seal();
+
+      /* orders the sealed graph so every node follows its dependencies and sets each
+      node's depth, its longest distance from a source. throws cycle_error on a cycle
+      of dependencies, loops through weak edges are allowed */
+      const std::vector<TaskInfo*> &sort();
+
+      /* the order found by the last sort() */
+      const std::vector<TaskInfo*> &sorted() const { return order; }
+
+      /* removes every node and edge, keeping allocated storage */
+      void clear();
+
+      /* left alone by clear(), a subflow resets it as its task runs again */
+      JoinedTime &joined() { return joined_time; }
+      const JoinedTime &joined() const { return joined_time; }
+
+      NodeArena::iterator begin() { return arena.begin(); }
+      NodeArena::iterator end() { return arena.end(); }
+      TaskInfo &operator[](size_t index) { return arena[index]; }
+      size_t size() const { return arena.size(); }
+      bool empty() const { return arena.empty(); }
+   private:
+      std::string describe_cycle();
+
+      NodeArena arena;
+      std::vector<std::pair<TaskInfo*, TaskInfo*>> edges;
+      std::vector<TaskInfo*> successors;
+      std::vector<size_t> offsets;
+      std::vector<TaskInfo*> order;
+      std::vector<int> pending;
+      JoinedTime joined_time;
+};
+
+/* Implementation */
+
+template<typename... Args>
+TaskInfo &NodeArena::emplace(Args&&... args) {
+   if (count == blocks.size() * block_size) {
+      blocks.push_back(std::make_unique<Block>());
+   }
+   TaskInfo *node = new(&blocks[count / block_size]->nodes()[count % block_size]) 
+      TaskInfo{std::forward<Args>(args)...};
+   node->id = count++;
+   return *node;
+}
+
+}
+
+#endif
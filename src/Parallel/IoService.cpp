@@ -0,0 +1,359 @@
+#include "IoService.hpp"
+#include "ThreadPool.hpp"
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <algorithm>
+#include <chrono>
+
+namespace Parallel {
+
+namespace {
+
+/* threads making blocking calls on regular files when there is no ring */
+constexpr int num_io_threads = 4;
+
+/* user_data of the no-op that stops the reaper */
+constexpr uint64_t stop_tag = 0;
+
+int uring_setup(const unsigned entries, io_uring_params &params) {
+   return static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+}
+
+int uring_enter(const int fd, const unsigned to_submit, const unsigned min_complete,
+ const unsigned flags) {
+   return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+      nullptr, 0));
+}
+
+template<typename T>
+T *at(void *base, const unsigned offset) {
+   return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+
+}
+
+size_t IoRequest::await_resume() const {
+   if (result < 0) {
+      static const char *names[] = {"read", "write", "fsync"};
+      throw std::system_error{static_cast<int>(-result), std::generic_category(),
+         names[static_cast<int>(op)]};
+   }
+   return static_cast<size_t>(result);
+}
+
+void IoRequest::suspend(CoroutineFrame &frame) {
+   if (service == nullptr) {
+      ThreadPool *pool = frame.owner();
+      service = (pool != nullptr) ? &pool->io() : &IoService::standalone();
+   }
+   waiting = &frame;
+   frame.park();
+   service->submit(*this);
+}
+
+bool IoService::bounded(const IoRequest &request) {
+   if (request.op == IoOp::fsync) {
+      return true;
+   }
+   struct stat info;
+   // a bad descriptor fails at once
+   return fstat(request.fd, &info) != 0 || S_ISREG(info.st_mode) || S_ISBLK(info.st_mode);
+}
+
+int64_t IoRequest::perform() const {
+   ssize_t done = 0;
+   switch (op) {
+      case IoOp::read:
+         done = (offset < 0) ? ::read(fd, buffer, size) : ::pread(fd, buffer, size, offset);
+         break;
+      case IoOp::write:
+         done = (offset < 0) ? ::write(fd, buffer, size) : ::pwrite(fd, buffer, size, offset);
+         break;
+      case IoOp::fsync:
+         done = ::fsync(fd);
+         break;
+   }
+   return (done < 0) ? -static_cast<int64_t>(errno) : static_cast<int64_t>(done);
+}
+
+IoService::IoService(const unsigned entries, const Backend preferred) :
+ stopping{false}, num_idle{0}, ring_fd{-1}, sq_ring{nullptr}, cq_ring{nullptr}, sqes{nullptr},
+ sq_ring_size{0}, cq_ring_size{0}, sqes_size{0}, sq_tail{nullptr}, sq_mask{0},
+ sq_array{nullptr}, cq_head{nullptr}, cq_tail{nullptr}, cq_mask{0}, cqes{nullptr},
+ capacity{0}, in_flight{0}, broken{0} {
+   if (preferred == Backend::uring && open_ring(std::max(entries, 2u))) {
+      threads.emplace_back([this]() { reap(); });
+      return;
+   }
+   for (int i = 0; i < num_io_threads; i++) {
+      threads.emplace_back([this]() { serve(); });
+   }
+}
+
+/* requests still in flight or waiting for room are finished first. completions
+are not ordered, so the reaper is only sent its stop no-op once none is left. a
+reaper polling a broken ring stops by itself once it sees none left */
+IoService::~IoService() {
+   {
+      std::unique_lock locker{lck};
+      stopping = true;
+      if (ring_fd >= 0) {
+         drained.wait(locker, [this]() { return in_flight == 0 && pending.empty(); });
+         // a busy ring frees up as the reaper takes completions
+         int error = (broken == 0) ? push(nullptr) : 0;
+         while ((error == EAGAIN || error == EBUSY) && broken == 0) {
+            locker.unlock();
+            std::this_thread::yield();
+            locker.lock();
+            error = push(nullptr);
+         }
+      }
+   }
+   queued.notify_all();
+   for (auto &thread : threads) {
+      thread.join();
+   }
+   close_ring();
+}
+
+IoService &IoService::standalone() {
+   static IoService instance;
+   return instance;
+}
+
+/* a full or busy ring keeps the request until completions make room. a request the
+ring refuses outright fails with the error. without a ring, a request that may wait
+on another one never queues behind busy threads, which could all be waiting on it */
+void IoService::submit(IoRequest &request) {
+   std::unique_lock locker{lck};
+   if (ring_fd < 0) {
+      pending.push_back(&request);
+      if (num_idle < pending.size() && !bounded(request)) {
+         threads.emplace_back([this]() { serve(); });
+      }
+      locker.unlock();
+      queued.notify_one();
+      return;
+   }
+   if (broken != 0) {
+      locker.unlock();
+      request.result = -broken;
+      request.waiting->wake();
+      return;
+   }
+   const int error = (in_flight == capacity) ? EAGAIN : push(&request);
+   if (error == 0) {
+      return;
+   }
+   if ((error == EAGAIN || error == EBUSY) && in_flight != 0) {
+      pending.push_back(&request);
+      return;
+   }
+   locker.unlock();
+   request.result = -error;
+   request.waiting->wake();
+}
+
+/* maps the ring and its entries. reads at the file position and keeping
+completions that overflow the ring are both needed, so older kernels get threads */
+bool IoService::open_ring(const unsigned entries) {
+   io_uring_params params;
+   std::memset(&params, 0, sizeof(params));
+   const int fd = uring_setup(entries, params);
+   if (fd < 0) {
+      return false;
+   }
+   ring_fd = fd;
+   const unsigned needed = IORING_FEAT_NODROP | IORING_FEAT_RW_CUR_POS;
+   if ((params.features & needed) != needed) {
+      close_ring();
+      return false;
+   }
+   sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+   cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+   const bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+   if (single) {
+      sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+   }
+   sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+      fd, IORING_OFF_SQ_RING);
+   if (sq_ring == MAP_FAILED) {
+      sq_ring = nullptr;
+      close_ring();
+      return false;
+   }
+   cq_ring = single ? sq_ring : mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+   sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+   sqes = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+      IORING_OFF_SQES);
+   if (cq_ring == MAP_FAILED || sqes == MAP_FAILED) {
+      cq_ring = (cq_ring == MAP_FAILED) ? nullptr : cq_ring;
+      sqes = (sqes == MAP_FAILED) ? nullptr : sqes;
+      close_ring();
+      return false;
+   }
+   sq_tail = at<unsigned>(sq_ring, params.sq_off.tail);
+   sq_mask = *at<unsigned>(sq_ring, params.sq_off.ring_mask);
+   sq_array = at<unsigned>(sq_ring, params.sq_off.array);
+   cq_head = at<unsigned>(cq_ring, params.cq_off.head);
+   cq_tail = at<unsigned>(cq_ring, params.cq_off.tail);
+   cq_mask = *at<unsigned>(cq_ring, params.cq_off.ring_mask);
+   cqes = at<void>(cq_ring, params.cq_off.cqes);
+   // the stop no-op needs room beyond a full ring
+   capacity = params.sq_entries - 1;
+   return true;
+}
+
+void IoService::close_ring() {
+   if (sqes != nullptr) {
+      munmap(sqes, sqes_size);
+   }
+   if (cq_ring != nullptr && cq_ring != sq_ring) {
+      munmap(cq_ring, cq_ring_size);
+   }
+   if (sq_ring != nullptr) {
+      munmap(sq_ring, sq_ring_size);
+   }
+   sqes = cq_ring = sq_ring = nullptr;
+   if (ring_fd >= 0) {
+      close(ring_fd);
+      ring_fd = -1;
+   }
+}
+
+/* fills the next entry and submits it at once, so the kernel has consumed every
+entry before the next push. a null request is the reaper's stop signal. returns 0
+or the error of the submission */
+int IoService::push(IoRequest *request) {
+   const unsigned tail = *sq_tail;
+   const unsigned index = tail & sq_mask;
+   io_uring_sqe &sqe = static_cast<io_uring_sqe*>(sqes)[index];
+   std::memset(&sqe, 0, sizeof(sqe));
+   if (request == nullptr) {
+      sqe.opcode = IORING_OP_NOP;
+      sqe.user_data = stop_tag;
+   } else {
+      switch (request->op) {
+         case IoOp::read: sqe.opcode = IORING_OP_READ; break;
+         case IoOp::write: sqe.opcode = IORING_OP_WRITE; break;
+         case IoOp::fsync: sqe.opcode = IORING_OP_FSYNC; break;
+      }
+      sqe.fd = request->fd;
+      sqe.addr = reinterpret_cast<uint64_t>(request->buffer);
+      sqe.len = static_cast<uint32_t>(std::min<size_t>(request->size, UINT32_MAX));
+      sqe.off = static_cast<uint64_t>(request->offset);
+      sqe.user_data = reinterpret_cast<uint64_t>(request);
+   }
+   sq_array[index] = index;
+   __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+   int submitted = uring_enter(ring_fd, 1, 0, 0);
+   while (submitted < 0 && errno == EINTR) {
+      submitted = uring_enter(ring_fd, 1, 0, 0);
+   }
+   if (submitted != 1) {
+      // the kernel did not take the entry, withdraw it
+      __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+      return (submitted < 0) ? errno : EAGAIN;
+   }
+   in_flight++;
+   return 0;
+}
+
+/* waits for completions, stores each result and wakes its frame, then refills the
+ring from the requests that found it full. results are stored under the lock the
+submitter held, which orders them after the request was filled in for threads
+that cannot see the ring. if the ring can no longer be waited on, the requests
+still pending fail with the error, and those in flight are polled for until they
+complete, since the kernel may still write their buffers */
+void IoService::reap() {
+   std::vector<std::pair<IoRequest*, int64_t>> done;
+   bool stop = false;
+   while (!stop) {
+      bool drain = false;
+      int failed = 0;
+      if (broken == 0) {
+         const int waited = uring_enter(ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+         if (waited < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            failed = errno;
+         }
+      } else {
+         // nothing can wait on the ring any more, the kernel still posts completions
+         std::this_thread::sleep_for(std::chrono::milliseconds{1});
+      }
+      unsigned head = *cq_head;
+      const unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+      for (; head != tail; head++) {
+         const io_uring_cqe &cqe = static_cast<io_uring_cqe*>(cqes)[head & cq_mask];
+         if (cqe.user_data == stop_tag) {
+            stop = true;
+            continue;
+         }
+         done.emplace_back(reinterpret_cast<IoRequest*>(cqe.user_data), cqe.res);
+      }
+      __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+      {
+         std::lock_guard locker{lck};
+         in_flight -= static_cast<unsigned>(done.size());
+         for (auto &[request, result] : done) {
+            request->result = result;
+         }
+         if (failed != 0) {
+            broken = failed;
+            for (IoRequest *request : pending) {
+               request->result = -failed;
+               done.emplace_back(request, -failed);
+            }
+            pending.clear();
+         }
+         while (!pending.empty() && in_flight < capacity) {
+            const int error = push(pending.front());
+            if (error == EAGAIN || error == EBUSY) {
+               break;
+            }
+            if (error != 0) {
+               pending.front()->result = -error;
+               done.emplace_back(pending.front(), -error);
+            }
+            pending.pop_front();
+         }
+         drain = stopping && in_flight == 0 && pending.empty();
+         // the stop no-op is not sent to a broken ring
+         stop = stop || (drain && broken != 0);
+      }
+      for (auto &completed : done) {
+         completed.first->waiting->wake();
+      }
+      done.clear();
+      if (drain) {
+         drained.notify_all();
+      }
+   }
+}
+
+void IoService::serve() {
+   std::unique_lock locker{lck};
+   while (true) {
+      num_idle++;
+      queued.wait(locker, [this]() { return stopping || !pending.empty(); });
+      num_idle--;
+      if (pending.empty()) {
+         return;
+      }
+      IoRequest *request = pending.front();
+      pending.pop_front();
+      locker.unlock();
+      request->result = request->perform();
+      request->waiting->wake();
+      locker.lock();
+   }
+}
+
+}
@@ -0,0 +1,145 @@
+#ifndef IOSERVICEHPP
+#define IOSERVICEHPP
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+
+#include "Coroutine.hpp"
+
+namespace Parallel {
+
+class IoService;
+
+enum class IoOp : uint8_t { read, write, fsync };
+
+/* one read, write or fsync awaited by a coroutine. co_await gives the number of
+bytes transferred, which may be short as with read(2) and write(2), and throws
+std::system_error if the call failed. an offset of -1 uses and moves the file's
+position, as pipes and sockets need. without a service the request goes to the
+one of the pool running the coroutine */
+class IoRequest {
+   public:
+      IoRequest(const IoOp op, const int fd, void *buffer, const size_t size,
+         const int64_t offset, IoService *service = nullptr) : op{op}, fd{fd}, 
+         buffer{buffer}, size{size}, offset{offset}, result{0}, service{service}, 
+         waiting{nullptr} {}
+
+      bool await_ready() const { return false; }
+      template<typename P>
+      void await_suspend(std::coroutine_handle<P> caller) { suspend(caller.promise()); }
+      size_t await_resume() const;
+   private:
+      void suspend(CoroutineFrame &frame);
+
+      /* runs the call on this thread, returns what it returned or -errno */
+      int64_t perform() const;
+
+      IoOp op;
+      int fd;
+      void *buffer;
+      size_t size;
+      int64_t offset;
+      int64_t result;
+      IoService *service;
+      CoroutineFrame *waiting;
+      friend class IoService;
+};
+
+inline IoRequest async_read(const int fd, void *buffer, const size_t size,
+ const int64_t offset = -1) {
+   return IoRequest{IoOp::read, fd, buffer, size, offset};
+}
+
+inline IoRequest async_write(const int fd, const void *buffer, const size_t size,
+ const int64_t offset = -1) {
+   return IoRequest{IoOp::write, fd, const_cast<void*>(buffer), size, offset};
+}
+
+inline IoRequest async_fsync(const int fd) {
+   return IoRequest{IoOp::fsync, fd, nullptr, 0, 0};
+}
+
+/* runs the I/O requests of coroutine tasks without holding their workers. requests
+are submitted to an io_uring ring, set up through the raw system calls, and a
+reaper thread wakes each request's frame as its completion arrives, which queues
+the task on its pool again. where the kernel refuses a ring, or lacks reads at the
+file position, threads make the same calls blocking instead. calls on regular
+files share a few threads, while one on a pipe, socket or other descriptor that
+may wait on another request gets a thread of its own when none is idle, and the
+threads added so are kept until the service is destroyed. a pool makes its service
+on first use, see ThreadPool::io; requests made off any pool go to a service
+shared by the process. destroying the service waits for the requests submitted.
+should waiting on the ring fail, requests not yet in it and any made later fail
+with the error, while those in flight are polled for until they complete */
+class IoService {
+   public:
+      enum class Backend { uring, threads };
+
+      explicit IoService(const unsigned entries = 256, const Backend preferred = Backend::uring);
+      ~IoService();
+      IoService(IoService&) =delete;
+      IoService &operator=(IoService&) =delete;
+
+      Backend backend() const { return (ring_fd >= 0) ? Backend::uring : Backend::threads; }
+
+      /* requests run by this service rather than the coroutine's pool's */
+      IoRequest read(const int fd, void *buffer, const size_t size, const int64_t offset = -1) {
+         return IoRequest{IoOp::read, fd, buffer, size, offset, this};
+      }
+      IoRequest write(const int fd, const void *buffer, const size_t size, 
+       const int64_t offset = -1) {
+         return IoRequest{IoOp::write, fd, const_cast<void*>(buffer), size, offset, this};
+      }
+      IoRequest fsync(const int fd) { return IoRequest{IoOp::fsync, fd, nullptr, 0, 0, this}; }
+
+      void submit(IoRequest &request);
+
+      static IoService &standalone();
+   private:
+      bool open_ring(const unsigned entries);
+      void close_ring();
+      /* ring only, called with lck held */
+      int push(IoRequest *request);
+      void reap();
+      void serve();
+
+      /* true if the request's call returns without waiting on other requests */
+      static bool bounded(const IoRequest &request);
+
+      std::mutex lck;
+      std::condition_variable queued; // threads backend only
+      std::condition_variable drained; // ring only, signalled once nothing is in flight
+      std::deque<IoRequest*> pending; // waiting for room in the ring, or for a thread
+      bool stopping;
+      std::vector<std::thread> threads;
+      size_t num_idle; // threads backend only, threads waiting for a request
+
+      int ring_fd;
+      void *sq_ring;
+      void *cq_ring;
+      void *sqes;
+      size_t sq_ring_size;
+      size_t cq_ring_size;
+      size_t sqes_size;
+      unsigned *sq_tail;
+      unsigned sq_mask;
+      unsigned *sq_array;
+      unsigned *cq_head;
+      unsigned *cq_tail;
+      unsigned cq_mask;
+      void *cqes;
+      unsigned capacity; // requests the ring holds in flight at once
+      unsigned in_flight;
+      int broken; // error that stopped the reaper waiting on the ring, 0 until then
+};
+
+}
+
+#endif
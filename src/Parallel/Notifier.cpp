@@ -0,0 +1,87 @@
+#include "Notifier.hpp"
+
+namespace Parallel {
+
+namespace {
+
+constexpr uint32_t awake = 0;
+constexpr uint32_t asleep = 1;
+
+}
+
+Notifier::Notifier(const int count) : 
+waiters(count), epoch{0}, num_waiting{0}, parked{nullptr} {}
+
+void Notifier::prepare_wait(const int id) {
+   waiters[id].epoch = epoch.load(std::memory_order_acquire);
+   num_waiting.fetch_add(1, std::memory_order_relaxed);
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void Notifier::cancel_wait(const int) {
+   num_waiting.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void Notifier::commit_wait(const int id) {
+   Waiter &self = waiters[id];
+   {
+      std::lock_guard locker{lck_park};
+      if (epoch.load(std::memory_order_relaxed) != self.epoch) {
+         // notified between prepare_wait() and now
+         num_waiting.fetch_sub(1, std::memory_order_relaxed);
+         return;
+      }
+      self.state.store(asleep, std::memory_order_relaxed);
+      self.next = parked;
+      parked = &self;
+   }
+   while (self.state.load(std::memory_order_acquire) == asleep) {
+      self.state.wait(asleep, std::memory_order_acquire);
+   }
+}
+
+void Notifier::notify_one() {
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+   if (num_waiting.load(std::memory_order_relaxed) == 0) {
+      return;
+   }
+   Waiter *target = nullptr;
+   {
+      std::lock_guard locker{lck_park};
+      epoch.fetch_add(1, std::memory_order_release);
+      target = parked;
+      if (target != nullptr) {
+         parked = target->next;
+         num_waiting.fetch_sub(1, std::memory_order_relaxed);
+      }
+   }
+   if (target != nullptr) {
+      target->state.store(awake, std::memory_order_release);
+      target->state.notify_one();
+   }
+}
+
+void Notifier::notify_all() {
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+   if (num_waiting.load(std::memory_order_relaxed) == 0) {
+      return;
+   }
+   Waiter *targets = nullptr;
+   {
+      std::lock_guard locker{lck_park};
+      epoch.fetch_add(1, std::memory_order_release);
+      targets = parked;
+      parked = nullptr;
+      for (Waiter *w = targets; w != nullptr; w = w->next) {
+         num_waiting.fetch_sub(1, std::memory_order_relaxed);
+      }
+   }
+   while (targets != nullptr) {
+      Waiter *next = targets->next;
+      targets->state.store(awake, std::memory_order_release);
+      targets->state.notify_one();
+      targets = next;
+   }
+}
+
+}
@@ -0,0 +1,47 @@
+#ifndef NOTIFIERHPP
+#define NOTIFIERHPP
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+
+#include "WorkStealingQueue.hpp"
+
+namespace Parallel {
+
+/* event count for parking idle workers, each on its own futex word. a worker 
+calls prepare_wait(), checks once more for work, then either cancel_wait()s or 
+commit_wait()s. a notify issued after prepare_wait() is never lost, and notify 
+is a fence and a load when nobody is waiting */
+class Notifier {
+   public:
+      Notifier(const int count);
+      Notifier(Notifier&) =delete;
+      Notifier &operator=(Notifier&) =delete;
+
+      void prepare_wait(const int id);
+      void cancel_wait(const int id);
+      void commit_wait(const int id);
+
+      /* wakes one parked waiter, or all of them */
+      void notify_one();
+      void notify_all();
+   private:
+      struct alignas(cache_size) Waiter {
+         Waiter() : state{0}, epoch{0}, next{nullptr} {}
+         std::atomic<uint32_t> state;
+         uint64_t epoch;
+         Waiter *next;
+      };
+
+      std::vector<Waiter> waiters;
+      std::atomic<uint64_t> epoch;
+      alignas(cache_size) std::atomic<size_t> num_waiting;
+      std::mutex lck_park;
+      Waiter *parked;
+};
+
+}
+
+#endif
@@ -0,0 +1,146 @@
+#include "Report.hpp"
+#include "Task.hpp"
+#include "Graph.hpp"
+
+#include <cstdio>
+#include <algorithm>
+
+namespace Parallel {
+
+namespace {
+
+struct Chain {
+   uint64_t work = 0;
+   uint64_t span = 0;
+   std::vector<PathStep> path;
+};
+
+/* longest path through a sorted graph, a node costing its own time plus the span
+of the subflow it spawned, which finishes before the node's dependents start. the 
+children a subflow joined take the place of the node's wait for them. an edge back 
+to an earlier node closes a condition's loop and is left out */
+Chain longest(const std::vector<TaskInfo*> &order) {
+   const size_t num_nodes = order.size();
+   std::vector<uint64_t> start(num_nodes, 0);
+   std::vector<const TaskInfo*> via(num_nodes, nullptr);
+   std::vector<std::vector<PathStep>> inner(num_nodes);
+   std::vector<char> visited(num_nodes, 0);
+   Chain chain;
+   const TaskInfo *last = nullptr;
+   for (const TaskInfo *node : order) {
+      uint64_t cost = node->elapsed_ns.load(std::memory_order_relaxed);
+      if (node->subgraph != nullptr) {
+         const JoinedTime &joined = node->subgraph->joined();
+         cost -= std::min(cost, joined.wait_ns);
+         chain.work += cost + joined.work_ns;
+         cost += joined.span_ns;
+      } else {
+         chain.work += cost;
+      }
+      if (node->subgraph != nullptr && !node->subgraph->empty()) {
+         Chain children = longest(node->subgraph->sorted());
+         cost += children.span;
+         chain.work += children.work;
+         inner[node->id] = std::move(children.path);
+      }
+      visited[node->id] = 1;
+      const uint64_t finish = start[node->id] + cost;
+      if (last == nullptr || finish > chain.span) {
+         chain.span = finish;
+         last = node;
+      }
+      for (TaskInfo *dep : node->dests) {
+         if (visited[dep->id]) {
+            continue;
+         }
+         if (via[dep->id] == nullptr || finish > start[dep->id]) {
+            start[dep->id] = finish;
+            via[dep->id] = node;
+         }
+      }
+   }
+   std::vector<const TaskInfo*> nodes;
+   for (const TaskInfo *node = last; node != nullptr; node = via[node->id]) {
+      nodes.push_back(node);
+   }
+   std::reverse(nodes.begin(), nodes.end());
+   for (const TaskInfo *node : nodes) {
+      chain.path.push_back(PathStep{node->id, node->mname, 
+         node->elapsed_ns.load(std::memory_order_relaxed)});
+      for (auto &step : inner[node->id]) {
+         chain.path.push_back(std::move(step));
+      }
+   }
+   return chain;
+}
+
+std::string duration(const uint64_t ns) {
+   char text[32];
+   if (ns >= 1000000000) {
+      std::snprintf(text, sizeof(text), "%.3f s", ns / 1e9);
+   } else if (ns >= 1000000) {
+      std::snprintf(text, sizeof(text), "%.3f ms", ns / 1e6);
+   } else {
+      std::snprintf(text, sizeof(text), "%.3f us", ns / 1e3);
+   }
+   return text;
+}
+
+}
+
+double RunReport::parallelism() const {
+   return (span_ns == 0) ? 0.0 : static_cast<double>(work_ns) / span_ns;
+}
+
+double RunReport::efficiency() const {
+   if (workers == 0 || makespan_ns == 0) {
+      return 0.0;
+   }
+   return static_cast<double>(work_ns) / (static_cast<double>(workers) * makespan_ns);
+}
+
+uint64_t RunReport::ideal_ns(const int n) const {
+   return std::max(work_ns / n, span_ns);
+}
+
+uint64_t RunReport::bound_ns(const int n) const {
+   return work_ns / n + span_ns;
+}
+
+void RunReport::write(std::ostream &out) const {
+   char line[128];
+   std::snprintf(line, sizeof(line), "work %s, span %s, parallelism %.2f\n",
+      duration(work_ns).c_str(), duration(span_ns).c_str(), parallelism());
+   out << line;
+   std::snprintf(line, sizeof(line), "run %s on %d workers, efficiency %.1f%%\n",
+      duration(makespan_ns).c_str(), workers, 100.0 * efficiency());
+   out << line;
+   out << "workers  fastest  greedy bound\n";
+   for (int n = 1; n <= std::max(1, 2 * workers); n *= 2) {
+      std::snprintf(line, sizeof(line), "%7d  %s  %s\n", n, 
+         duration(ideal_ns(n)).c_str(), duration(bound_ns(n)).c_str());
+      out << line;
+   }
+   out << "critical path, " << critical_path.size() << " tasks of " << levels << " levels:\n";
+   for (auto &step : critical_path) {
+      out << "   " << (step.name.empty() ? "#" + std::to_string(step.id) : step.name)
+         << "  " << duration(step.elapsed_ns) << '\n';
+   }
+}
+
+RunReport analyze(const std::vector<TaskInfo*> &order, const uint64_t makespan_ns, 
+ const int workers) {
+   Chain chain = longest(order);
+   RunReport report;
+   report.work_ns = chain.work;
+   report.span_ns = chain.span;
+   report.makespan_ns = makespan_ns;
+   report.workers = workers;
+   report.critical_path = std::move(chain.path);
+   for (const TaskInfo *node : order) {
+      report.levels = std::max(report.levels, static_cast<size_t>(node->depth) + 1);
+   }
+   return report;
+}
+
+}
@@ -0,0 +1,58 @@
+#ifndef REPORTHPP
+#define REPORTHPP
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <cstdint>
+#include <cstddef>
+
+namespace Parallel {
+
+struct TaskInfo;
+
+/* one task of a critical path */
+struct PathStep {
+   size_t id;
+   std::string name;
+   uint64_t elapsed_ns;
+};
+
+/* how the last run of a graph used its workers, from the measured durations of its
+tasks. work is the time of every task together and span the time of the longest 
+chain of dependent tasks, so no number of workers finishes a run faster than span 
+and work / span is the most workers the graph can keep busy. a subflow's children 
+count towards the work and span of the task that spawned them, those it joined in
+place of its wait in join(); joined children are left off the critical path */
+struct RunReport {
+   uint64_t work_ns = 0;
+   uint64_t span_ns = 0;
+   uint64_t makespan_ns = 0; // wall time of the run
+   size_t levels = 0;        // tasks on the longest chain by count, ignoring durations
+   int workers = 0;
+   std::vector<PathStep> critical_path; // the chain whose durations add up to span
+
+   /* work / span */
+   double parallelism() const;
+
+   /* share of the workers' time spent running tasks, work / (workers * makespan) */
+   double efficiency() const;
+
+   /* fastest possible run on n workers, max(work / n, span) */
+   uint64_t ideal_ns(const int n) const;
+
+   /* what a greedy scheduler guarantees on n workers, work / n + span */
+   uint64_t bound_ns(const int n) const;
+
+   /* writes a readable summary, with the bounds for worker counts up to twice the 
+   pool's and the critical path */
+   void write(std::ostream &out) const;
+};
+
+/* computes the report of a run from a graph's nodes in dependency order */
+RunReport analyze(const std::vector<TaskInfo*> &order, const uint64_t makespan_ns, 
+   const int workers);
+
+}
+
+#endif
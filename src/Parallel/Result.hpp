@@ -0,0 +1,222 @@
+#ifndef RESULTHPP
+#define RESULTHPP
+
+#include <new>
+#include <atomic>
+#include <future>
+#include <tuple>
+#include <utility>
+#include <type_traits>
+
+#include "Task.hpp"
+#include "Errors.hpp"
+#include "Coroutine.hpp"
+
+namespace Parallel {
+
+/* storage for the value returned by a task, or the exception it threw. the slot 
+lives inside the task's closure, so setting it allocates nothing; each run replaces
+the value */
+template<typename T>
+class Slot {
+   public:
+      Slot() : ready{false}, filled{false}, engaged{false} {}
+      ~Slot() { clear(); }
+      Slot(const Slot&) =delete;
+      Slot &operator=(const Slot&) =delete;
+      Slot(Slot &&other) noexcept(std::is_nothrow_move_constructible_v<T>) : 
+       ready{other.ready.load(std::memory_order_relaxed)}, filled{other.filled.is_set()}, 
+       engaged{other.engaged}, 
+       error{other.error} {
+         if (engaged) {
+            new(storage) T(std::move(other.value()));
+         }
+      }
+
+      template<typename... Args>
+      void set(Args&&... args) {
+         clear();
+         new(storage) T(std::forward<Args>(args)...);
+         engaged = true;
+         ready.store(true, std::memory_order_release);
+         ready.notify_all();
+         filled.set();
+      }
+
+      void fail(std::exception_ptr thrown) {
+         clear();
+         error = std::move(thrown);
+         ready.store(true, std::memory_order_release);
+         ready.notify_all();
+         filled.set();
+      }
+
+      /* called as a new run of the producer starts, so awaits wait for its value */
+      void rearm() { filled.reset(); }
+
+      void wait() const { ready.wait(false, std::memory_order_acquire); }
+      bool is_ready() const { return ready.load(std::memory_order_acquire); }
+      Event &ready_event() { return filled; }
+      T &value() { return *std::launder(reinterpret_cast<T*>(storage)); }
+
+      /* the value, or the exception the task threw in its place */
+      T &get() {
+         if (error != nullptr) {
+            std::rethrow_exception(error);
+         }
+         return value();
+      }
+   private:
+      void clear() {
+         if (engaged) {
+            value().~T();
+            engaged = false;
+         }
+         error = nullptr;
+      }
+
+      alignas(T) unsigned char storage[sizeof(T)];
+      std::atomic<bool> ready;
+      Event filled; // set with ready, for coroutines to await
+      bool engaged;
+      std::exception_ptr error;
+};
+
+/* handle to the value a task returns. get() waits for the first run of the task to
+produce a value; after Scheduler::wait() it reads the latest run's value without 
+waiting or locking. if the task threw, get() rethrows the exception, and if its run 
+was cancelled before it started, get() throws cancelled_error. co_await in a 
+coroutine task gets it the same way without blocking the worker, waiting for the 
+run of the producer in progress once that run has started. passed as an 
+argument to Scheduler::add or silent_add, it wires the producing task in front of 
+the new task and hands it the value as an rvalue */
+template<typename T>
+class Result {
+   public:
+      Result() : slot{nullptr}, producer{nullptr} {}
+      Result(Slot<T> &storage, TaskInfo &node) : slot{&storage}, producer{&node} {}
+
+      bool valid() const { return slot != nullptr; }
+      bool ready() const { return slot->is_ready(); }
+      void wait() const { slot->wait(); }
+      T &get() { 
+         slot->wait(); 
+         return slot->get(); 
+      }
+
+      auto operator co_await() const {
+         struct Awaiter : Event::Awaiter {
+            Awaiter(Slot<T> &storage) : Event::Awaiter{storage.ready_event()}, slot{&storage} {}
+            T &await_resume() const { return slot->get(); }
+            Slot<T> *slot;
+         };
+         return Awaiter{*slot};
+      }
+   private:
+      template<typename Func, typename... Args>
+      friend struct Bound;
+      friend class FlowBuilder;
+
+      Slot<T> *slot;
+      TaskInfo *producer;
+};
+
+/* type a bound argument is passed to the task as: Results are moved out of their 
+slot, anything else is passed as an lvalue of the stored copy */
+template<typename A>
+struct ArgumentOf { using type = std::decay_t<A>&; };
+template<typename T>
+struct ArgumentOf<Result<T>> { using type = T&&; };
+
+template<typename A>
+constexpr bool is_result = false;
+template<typename T>
+constexpr bool is_result<Result<T>> = true;
+
+template<typename Func, typename... Args>
+using ReturnOf = std::invoke_result_t<std::decay_t<Func>&, 
+   typename ArgumentOf<std::decay_t<Args>>::type...>;
+
+/* a task with its arguments stored alongside it */
+template<typename Func, typename... Args>
+struct Bound {
+   template<typename F, typename... A>
+   Bound(F &&f, A&&... a) : task{std::forward<F>(f)}, args{std::forward<A>(a)...} {}
+
+   decltype(auto) operator()() {
+      return std::apply([this](auto&... stored) -> decltype(auto) {
+         return task(pass(stored)...);
+      }, args);
+   }
+
+   template<typename A>
+   static A &pass(A &arg) { return arg; }
+   /* the edge from the producer guarantees the slot is filled before this runs */
+   template<typename T>
+   static T &&pass(Result<T> &arg) { return std::move(arg.slot->value()); }
+
+   Func task;
+   std::tuple<Args...> args;
+};
+
+/* closure of a task added with Scheduler::add, keeps the task's return value */
+template<typename Func, typename T>
+struct Producer {
+   template<typename F>
+   Producer(F &&f) : task{std::forward<F>(f)} {}
+   Producer(Producer&&) =default;
+   void operator()() {
+      if (run_cancelled()) {
+         slot.fail(std::make_exception_ptr(cancelled_error{"task was cancelled"}));
+         return;
+      }
+      slot.rearm();
+      try {
+         slot.set(task());
+      } catch (...) {
+         slot.fail(std::current_exception());
+         throw;
+      }
+   }
+
+   Func task;
+   Slot<T> slot;
+};
+
+/* closure of a task added with Scheduler::add whose callable returns Coroutine<T>, 
+keeps the value the coroutine returns once it finishes */
+template<typename Func, typename T>
+struct AsyncProducer {
+   template<typename F>
+   AsyncProducer(F &&f, TaskInfo &owner) : task{std::forward<F>(f)}, node{&owner} {}
+   AsyncProducer(AsyncProducer&&) =default;
+   void operator()() {
+      if (run_cancelled()) {
+         slot.fail(std::make_exception_ptr(cancelled_error{"task was cancelled"}));
+         return;
+      }
+      auto make = [this]() {
+         slot.rearm();
+         return deliver(task, slot);
+      };
+      frame.step(*node, make);
+   }
+
+   static Coroutine<> deliver(Func &task, Slot<T> &slot) {
+      try {
+         slot.set(co_await task());
+      } catch (...) {
+         slot.fail(std::current_exception());
+         throw;
+      }
+   }
+
+   Func task;
+   TaskInfo *node;
+   Coroutine<> frame;
+   Slot<T> slot;
+};
+
+}
+
+#endif
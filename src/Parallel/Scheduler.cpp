@@ -1,47 +1,179 @@
 #include "Scheduler.hpp"
 
+#include <algorithm>
+
 namespace Parallel {
 
-namespace {
+void Scheduler::compile() {
+   if (!topology.done()) {
+      throw std::logic_error{"compile() while the graph is running"};
+   }
+   build();
+}
+
+void Scheduler::build() {
+   if (vertices.empty()) {
+      throw std::logic_error{"execute() must execute tasks"};
+   }
+   vertices.seal();
+   vertices.sort();
+   // a task behind a weak edge waits for its condition, even without dependencies
+   std::vector<char> branched(vertices.size(), 0);
+   bool conditional = false;
+   for (auto &node : vertices) {
+      if (node.condition) {
+         conditional = true;
+         for (TaskInfo *dep : node.dests) {
+            branched[dep->id] = 1;
+         }
+      }
+   }
+   topology.sources.clear();
+   topology.rearmed.clear();
+   for (auto &node : vertices) {
+      node.topology = &topology;
+      if (node.join_count == 0 && !branched[node.id]) {
+         topology.sources.push_back(&node);
+      } else if (conditional && node.join_count != 0) {
+         topology.rearmed.push_back(&node);
+      }
+   }
+   changed = false;
+}
 
-int assign_depth(int depth, TaskInfo &node) {
-   if (node.visiting) {
-      throw std::logic_error{"task dependencies must be acyclic"};
+void Scheduler::prioritize(const PriorityPolicy policy) {
+   if (!topology.done()) {
+      throw std::logic_error{"prioritize() while the graph is running"};
    }
-   node.visiting = true;
-   node.depth = (node.depth > depth) ? node.depth : depth;
-   int max_depth = node.depth;
-   for (auto *edge : node.dests) {
-      max_depth = assign_depth(depth + 1, *edge);
+   priorities = policy;
+   if (policy == PriorityPolicy::none) {
+      for (auto &node : vertices) {
+         node.priority = 0;
+      }
    }
-   node.visiting = false; 
-   return max_depth;
 }
 
+/* bottom levels in reverse dependency order, then priorities by splitting the 
+longest into equal bands, the top band being the most urgent. sources are queued 
+in order, so they are sorted most urgent first */
+void Scheduler::rank() {
+   auto weight = [this](const TaskInfo &node) -> uint64_t {
+      const uint64_t measured = node.elapsed_ns.load(std::memory_order_relaxed);
+      if (priorities == PriorityPolicy::measured && measured != 0) {
+         return measured;
+      } else if (priorities != PriorityPolicy::hops && node.cost != 0) {
+         return node.cost;
+      }
+      return 1;
+   };
+   const auto &order = vertices.sorted();
+   std::vector<uint64_t> bottom(order.size());
+   uint64_t longest = 0;
+   for (auto it = order.rbegin(); it != order.rend(); ++it) {
+      const TaskInfo *node = *it;
+      uint64_t below = 0;
+      for (const TaskInfo *dep : node->dests) {
+         below = std::max(below, bottom[dep->id]);
+      }
+      bottom[node->id] = below + weight(*node);
+      longest = std::max(longest, bottom[node->id]);
+   }
+   for (TaskInfo *node : order) {
+      const auto band = static_cast<int>(static_cast<double>(bottom[node->id]) * num_priorities 
+         / (static_cast<double>(longest) + 1.0));
+      node->priority = static_cast<uint8_t>(num_priorities - 1 - std::min(band, num_priorities - 1));
+   }
+   std::stable_sort(topology.sources.begin(), topology.sources.end(), 
+      [](const TaskInfo *a, const TaskInfo *b) { return a->priority < b->priority; });
 }
 
 void Scheduler::execute() {
-   if (vertices.empty()) {
-      throw std::logic_error{"execute() must execute tasks"};
+   start(1, nullptr);
+}
+
+void Scheduler::run_n(size_t n) {
+   start(n, nullptr);
+}
+
+void Scheduler::run_until(std::function<bool()> pred) {
+   start(0, std::move(pred));
+}
+
+/* a run started from another thread, or a module used by two graphs at once, 
+loses the claim rather than preparing the topology under a run in progress */
+void Scheduler::prepare() {
+   if (!topology.claim()) {
+      throw std::logic_error{"graph is already running"};
    }
-   int max_depth{};
-   for (auto &node : vertices) {
-      int curr_depth = 0;
-      if (node.num_deps == 0) {
-         curr_depth = assign_depth(0, node);
+   try {
+      if (changed) {
+         build();
       }
-      max_depth = (max_depth > curr_depth) ? max_depth : curr_depth;
+      if (priorities != PriorityPolicy::none) {
+         rank();
+      }
+   } catch (...) {
+      topology.release();
+      throw;
    }
-   Topology sorted;
-   sorted.resize(max_depth + 1);
-   for (auto &node : vertices) {
-      sorted[node.depth].push_back(&node);
+}
+
+void Scheduler::start(size_t repeats, std::function<bool()> &&pred) {
+   prepare();
+   bool idle;
+   try {
+      idle = (pred && pred()) || (!pred && repeats == 0);
+   } catch (...) {
+      topology.release();
+      throw;
+   }
+   if (idle) {
+      topology.release();
+      return;
    }
-   threads.dispatch(sorted);
+   topology.repeats = repeats;
+   topology.predicate = std::move(pred);
+   topology.outer = nullptr;
+   threads->dispatch(topology);
+}
+
+/* the run is dispatched to the pool running the module task, whose worker queues 
+the sources on its own deque. off the pool the graph runs on its own pool while the
+calling thread waits */
+Coroutine<> Scheduler::embed(TaskInfo &module) {
+   Worker *worker = Worker::this_worker();
+   ThreadPool *pool = (worker != nullptr && module.topology != nullptr) ? worker->pool() : threads;
+   prepare();
+   topology.repeats = 1;
+   topology.predicate = nullptr;
+   topology.outer = module.topology;
+   pool->dispatch(topology);
+   co_await topology.completion;
+   wait();
 }
 
 void Scheduler::wait() {
-   threads.wait_for_all();
+   topology.wait();
+   if (std::exception_ptr error = topology.take_error()) {
+      std::rethrow_exception(error);
+   }
+}
+
+bool Scheduler::dump_trace(const std::string &path) {
+   topology.wait();
+   return threads->dump_trace(path);
 }
 
-}
\ No newline at end of file
+RunReport Scheduler::report() {
+   topology.wait();
+   if (changed || topology.finished_ns == 0) {
+      throw std::logic_error{"report() needs a finished run of the current graph"};
+   }
+   RunReport result = analyze(vertices.sorted(), topology.makespan_ns(), threads->size());
+   if (result.work_ns == 0) {
+      throw std::logic_error{"report() needs stats counted or tracing on to time tasks"};
+   }
+   return result;
+}
+
+}
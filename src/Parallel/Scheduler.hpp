@@ -1,138 +1,130 @@
 #ifndef SCHEDULERHPP
 #define SCHEDULERHPP 
 
-#include <future>
 #include <utility>
-#include <list>
+#include <memory>
 #include <iostream>
 #include <vector>
+#include <functional>
+#include <type_traits>
 
 #include "Task.hpp"
+#include "Graph.hpp"
+#include "FlowBuilder.hpp"
 #include "ThreadPool.hpp"
+#include "Report.hpp"
 
 namespace Parallel {
 
+/* how a graph's tasks are ranked for the workers, who pop and steal the most urgent
+ready task first. none leaves every task equal; the others rank a task by its 
+bottom level, the length of the longest path from it to the end of the graph, so
+that tasks heading long chains start early. hops counts each task as one, 
+estimates uses the costs given with Task::cost, and measured uses how long each 
+task took in the previous run, timed while stats are counted or the pool traces.
+a task without a cost or measurement counts as one. a subflow's children share 
+the rank of the task spawning them */
+enum class PriorityPolicy { none, hops, estimates, measured };
+
 /* non-copy constructible/assignable task dependency graph,
-directed and acyclic, handles submission and direction of tasks */
-class Scheduler {
+directed and acyclic, handles submission and direction of tasks. runs on its
+own pool, or on a pool shared with other schedulers */
+class Scheduler : public FlowBuilder {
    public:
-      Scheduler() : vertices{} {}
-      ~Scheduler() {}
+      Scheduler() : 
+         FlowBuilder{graph}, owned{std::make_unique<ThreadPool>()}, threads{owned.get()} {}
+      Scheduler(ThreadPool &pool) : FlowBuilder{graph}, threads{&pool} {}
+      ~Scheduler() { topology.wait(); }
       Scheduler(Scheduler&) =delete;
       Scheduler &operator=(Scheduler&) =delete;
-      Scheduler(Scheduler&&) noexcept =default;
-      Scheduler &operator=(Scheduler&&) noexcept =default;
-
-      /* adds a void-returning task to the graph, returns a handle to the task */
-      template<typename Func>
-      Task silent_add(Func &&task);
-      template<typename Func, typename... Args>
-      Task silent_add(Func &&task, Args&&... args);
 
-      /* adds a non-void returning task to the graph, returns a handle to the task */
-      template<typename Func>
-      auto add(Func &&task) 
-         -> std::pair<Task, std::future<decltype(task())>>;
+      /* adds a condition task, whose int return value picks the one successor to run
+      next: 0 for the first task it directs, 1 for the second, in the order the edges 
+      were declared, and any other value for none. its edges are weak, they are not
+      dependencies, so a condition may lead back to an earlier task and loop within
+      a single run. a task reached only through conditions is not a source, and a 
+      picked task runs at once, so its other dependencies should be done by then. 
+      arguments are bound as with silent_add */
       template<typename Func, typename... Args>
-      auto add(Func &&task, Args&&... args)
-         -> std::pair<Task, std::future<decltype(task(args...))>>;
+      Task condition(Func &&task, Args&&... args);
 
-      /* creates separate dependencies from root to all listed targets */
-      template<typename... T>
-      void direct(Task &root, T&... targets);
+      /* checks the graph and snapshots its dependency counts and sources. done
+      implicitly by the first run after the graph changes */
+      void compile();
 
-      /* creates linear dependencies from root to last target listed */
-      template<typename T>
-      void linearize(Task &root, T &last);
-      template<typename T, typename... Tp>
-      void linearize(Task &root, T &first, Tp&... rest);
+      /* sets the ranking of the graph's tasks, recomputed at the start of each
+      execute(), run_n() or run_until() */
+      void prioritize(const PriorityPolicy policy);
 
-      /* debug: passes off to threadpool, executes task graph */
+      /* runs the task graph once on the pool, returns without waiting */
       void execute();
 
-      /* wait for threads to finish executing */
+      /* runs the task graph n times back to back, returns without waiting */
+      void run_n(size_t n);
+
+      /* runs the task graph until pred, checked before each run, returns true. 
+      returns without waiting */
+      void run_until(std::function<bool()> pred);
+
+      /* wait for the graph to finish executing, the pool's threads keep running. 
+      rethrows the first exception a task of the run threw, which cancelled the run */
       void wait();      
+
+      /* stops the run in progress, see Topology::cancel. the next run starts afresh */
+      void cancel() { topology.cancel(); }
+
+      /* cancels this graph's runs from any thread, or lets tasks check for it */
+      CancellationToken token() { return CancellationToken{topology}; }
+
+      /* set while the graph is not running, so a coroutine task of another graph 
+      may co_await the run in progress without blocking its worker. wait() after 
+      it rethrows the run's exception, if any */
+      Event &completion() { return topology.completion; }
+
+      /* waits for the graph, then writes the pool's trace, see ThreadPool::enable_tracing */
+      bool dump_trace(const std::string &path);
+
+      /* waits for the graph, then reports the work, span and critical path of its 
+      last run, a task run more than once by a loop counting its last call. tasks
+      are timed while stats are counted or the pool is tracing, otherwise throws
+      std::logic_error, as it does before the first run or after the graph changed */
+      RunReport report();
    private:
-      std::list<TaskInfo> vertices;
-      ThreadPool threads;
+      /* claims the run, then compiles and ranks the graph as needed */
+      void prepare();
+      void build();
+      void start(size_t repeats, std::function<bool()> &&pred);
+
+      /* runs the graph once for a module task of another graph, see FlowBuilder::module */
+      Coroutine<> embed(TaskInfo &module);
+      void rank();
+
+      Graph graph;
+      Topology topology;
+      std::unique_ptr<ThreadPool> owned;
+      ThreadPool *threads;
+      PriorityPolicy priorities = PriorityPolicy::none;
+      friend class FlowBuilder;
 };
 
 /* Implementation */
 
-template<typename Func>
-Task Scheduler::silent_add(Func &&task) {
-   vertices.emplace_back(Executor::make_closure(std::forward<Func>(task)));
-   return Task{vertices.back()};
-}
-
 template<typename Func, typename... Args>
-Task Scheduler::silent_add(Func &&task, Args&&... args) {
-   vertices.emplace_back(Executor::make_closure(
-      [task = std::forward<Func>(task), 
-      args_tup = std::make_tuple(std::forward<Args>(args)...)]() {
-         std::apply([&task](auto&... args) {
-            task(std::forward<decltype(args)>(args)...);
-         }, args_tup);
-      })
-   );
-   return Task{vertices.back()};
-}
-
-template<typename Func>
-auto Scheduler::add(Func &&task) 
--> std::pair<Task, std::future<decltype(task())>> {
-   using RetType = decltype(task());
-   std::promise<RetType> ret_promise;
-   std::future<RetType> ret = ret_promise.get_future();
-   auto closure = Executor::make_closure(
-      [ret_promise = std::move(ret_promise),
-      task = std::forward<Func>(task)]() mutable {
-         ret_promise.set_value(task());
+Task Scheduler::condition(Func &&task, Args&&... args) {
+   static_assert(std::is_convertible_v<ReturnOf<Func, Args...>, int>, 
+      "a condition task returns the index of a successor");
+   TaskInfo &node = vertices.emplace();
+   wire(node, args...);
+   node.exec = Executor::make_closure(
+      [call = bind(std::forward<Func>(task), std::forward<Args>(args)...), &node]() mutable {
+         // a call that throws picks nothing
+         node.branch = -1;
+         node.branch = static_cast<int>(call());
       }
    );
-   vertices.emplace_back(std::move(closure));
-   return std::make_pair(Task{vertices.back()}, std::move(ret));
-}
-
-template<typename Func, typename... Args>
-auto Scheduler::add(Func &&task, Args&&... args) 
--> std::pair<Task, std::future<decltype(task(args...))>> {
-   using RetType = decltype(task(args...));
-   std::promise<RetType> ret_promise;
-   std::future<RetType> ret = ret_promise.get_future();
-   auto closure = Executor::make_closure(
-      [ret_promise = std::move(ret_promise),
-      task = std::forward<Func>(task),
-      args_tup = std::make_tuple(std::forward<Args>(args)...)]() mutable {
-         ret_promise.set_value(std::apply(
-            [&task](auto&... args) -> RetType {
-               return task(std::forward<decltype(args)>(args)...);
-            }, args_tup));
-      }
-   ); 
-   vertices.emplace_back(std::move(closure));
-   return std::make_pair(Task{vertices.back()}, std::move(ret));
-}
-
-template<typename... T>
-void Scheduler::direct(Task &root, T&... targets) {
-   static_assert(sizeof...(targets) > 0, "root must direct targets");
-   static_assert((std::is_same_v<Task, T> && ...), "only Tasks may direct");
-   (root.node->add_dep(targets.node), ...);
-}
-
-template<typename T>
-void Scheduler::linearize(Task &root, T &last) {
-   static_assert(std::is_same_v<Task, T>, "only Tasks may linearize");
-   root.node->add_dep(last.node);
-}
-
-template<typename T, typename... Tp>
-void Scheduler::linearize(Task &root, T &first, Tp&... rest) {
-   static_assert(std::is_same_v<Task, T> && (std::is_same_v<Task, Tp> && ...), 
-      "only Tasks may linearize");
-   root.node->add_dep(first.node);
-   linearize(first, rest...);
+   node.condition = true;
+   changed = true;
+   return Task{node};
 }
 
 }
@@ -0,0 +1,132 @@
+#ifndef STATSHPP
+#define STATSHPP
+
+#include <atomic>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+/* runtime counters of the pool's workers, on unless NDEBUG is defined. when off,
+counting and timestamps compile to nothing and stats() reports zeros */
+#ifndef PARALLEL_STATS
+#ifdef NDEBUG
+#define PARALLEL_STATS 0
+#else
+#define PARALLEL_STATS 1
+#endif
+#endif
+
+namespace Parallel {
+
+constexpr bool stats_enabled = PARALLEL_STATS != 0;
+
+/* nanoseconds on a monotonic clock */
+inline uint64_t clock_ns() {
+   return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+/* counts of one worker, or of a whole pool, since the last reset */
+struct WorkerStats {
+   uint64_t tasks = 0;         // tasks run
+   uint64_t pops = 0;          // tasks taken from the worker's own queue
+   uint64_t steals = 0;        // tasks taken from another worker's queue
+   uint64_t failed_steals = 0; // steal rounds that found nothing
+   uint64_t submissions = 0;   // tasks taken from the pool's submission queue
+   uint64_t parks = 0;         // times the worker went to sleep
+   uint64_t idle_ns = 0;       // time spent looking for work or asleep
+   uint64_t wait_ns = 0;       // time tasks spent ready but queued
+   uint64_t exec_ns = 0;       // time spent running tasks
+
+   WorkerStats &operator+=(const WorkerStats &other);
+   WorkerStats operator-(const WorkerStats &other) const;
+};
+
+struct PoolStats {
+   std::vector<WorkerStats> workers;
+   WorkerStats total;
+};
+
+/* counters written by their worker alone and read by any thread, kept apart from
+other workers' counters so that counting does not share cache lines */
+class alignas(64) WorkerCounters {
+   public:
+      WorkerCounters() : tasks{0}, pops{0}, steals{0}, failed_steals{0}, submissions{0},
+         parks{0}, idle_ns{0}, wait_ns{0}, exec_ns{0} {}
+
+      /* owner only */
+      static void add(std::atomic<uint64_t> &counter, const uint64_t amount = 1) {
+         if constexpr (stats_enabled) {
+            counter.store(counter.load(std::memory_order_relaxed) + amount,
+               std::memory_order_relaxed);
+         }
+      }
+
+      /* nanoseconds on a monotonic clock, 0 when counting is off */
+      static uint64_t stamp() {
+         if constexpr (stats_enabled) {
+            return clock_ns();
+         } else {
+            return 0;
+         }
+      }
+
+      WorkerStats snapshot() const;
+
+      std::atomic<uint64_t> tasks;
+      std::atomic<uint64_t> pops;
+      std::atomic<uint64_t> steals;
+      std::atomic<uint64_t> failed_steals;
+      std::atomic<uint64_t> submissions;
+      std::atomic<uint64_t> parks;
+      std::atomic<uint64_t> idle_ns;
+      std::atomic<uint64_t> wait_ns;
+      std::atomic<uint64_t> exec_ns;
+};
+
+/* Implementation */
+
+inline WorkerStats &WorkerStats::operator+=(const WorkerStats &other) {
+   tasks += other.tasks;
+   pops += other.pops;
+   steals += other.steals;
+   failed_steals += other.failed_steals;
+   submissions += other.submissions;
+   parks += other.parks;
+   idle_ns += other.idle_ns;
+   wait_ns += other.wait_ns;
+   exec_ns += other.exec_ns;
+   return *this;
+}
+
+inline WorkerStats WorkerStats::operator-(const WorkerStats &other) const {
+   WorkerStats diff;
+   diff.tasks = tasks - other.tasks;
+   diff.pops = pops - other.pops;
+   diff.steals = steals - other.steals;
+   diff.failed_steals = failed_steals - other.failed_steals;
+   diff.submissions = submissions - other.submissions;
+   diff.parks = parks - other.parks;
+   diff.idle_ns = idle_ns - other.idle_ns;
+   diff.wait_ns = wait_ns - other.wait_ns;
+   diff.exec_ns = exec_ns - other.exec_ns;
+   return diff;
+}
+
+inline WorkerStats WorkerCounters::snapshot() const {
+   WorkerStats stats;
+   stats.tasks = tasks.load(std::memory_order_relaxed);
+   stats.pops = pops.load(std::memory_order_relaxed);
+   stats.steals = steals.load(std::memory_order_relaxed);
+   stats.failed_steals = failed_steals.load(std::memory_order_relaxed);
+   stats.submissions = submissions.load(std::memory_order_relaxed);
+   stats.parks = parks.load(std::memory_order_relaxed);
+   stats.idle_ns = idle_ns.load(std::memory_order_relaxed);
+   stats.wait_ns = wait_ns.load(std::memory_order_relaxed);
+   stats.exec_ns = exec_ns.load(std::memory_order_relaxed);
+   return stats;
+}
+
+}
+
+#endif
@@ -3,46 +3,81 @@
 
 #include <string>
 #include <vector>
-#include <unordered_set>
 #include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 
 #include "Executor.hpp"
 
 namespace Parallel {
 
+class Topology;
+class Graph;
+struct TaskInfo;
+
+/* levels of task priority, 0 being the most urgent */
+constexpr int num_priorities = 4;
+
+/* true while a worker calls a task only to tell it that its run was cancelled, 
+which it does for tasks that set sees_cancel in place of skipping them. such a task
+should fail whatever waits on its value and return */
+bool run_cancelled();
+
+/* deletes a graph where its type is complete, so nodes can own one */
+struct GraphDeleter {
+   void operator()(Graph *graph) const;
+};
+
+/* a node's successors, a span of the graph's compressed successor array */
+struct Successors {
+   Successors() : first{nullptr}, last{nullptr} {}
+   Successors(TaskInfo **first, TaskInfo **last) : first{first}, last{last} {}
+   TaskInfo **begin() const { return first; }
+   TaskInfo **end() const { return last; }
+   size_t size() const { return last - first; }
+   bool empty() const { return first == last; }
+
+   TaskInfo **first;
+   TaskInfo **last;
+};
+
 struct TaskInfo {
-   TaskInfo() : depth{0}, num_deps{0}, visiting{false} {}
-   TaskInfo(Executor &&exec) : exec{std::move(exec)}, depth{0}, num_deps{0}, visiting{false} {}
+   TaskInfo() : id{0}, depth{0}, join_count{0}, num_deps{0}, branch{-1}, topology{nullptr}, 
+      parent{nullptr}, num_children{0}, ready_at{0}, elapsed_ns{0}, cost{0}, priority{0}, 
+      sees_cancel{false}, condition{false} {}
+   TaskInfo(Executor &&exec) : 
+      exec{std::move(exec)}, id{0}, depth{0}, join_count{0}, num_deps{0}, branch{-1}, 
+      topology{nullptr}, parent{nullptr}, num_children{0}, ready_at{0}, elapsed_ns{0}, cost{0},
+      priority{0}, sees_cancel{false}, condition{false} {}
    ~TaskInfo() {}
    TaskInfo(const TaskInfo&) =delete;
    TaskInfo &operator=(const TaskInfo&) =delete;
-   TaskInfo(TaskInfo &&other) noexcept : 
-      exec{std::move(other.exec)}, depth{other.depth}, dests{std::move(other.dests)}, 
-      num_deps{other.num_deps.load()}, visiting{other.visiting} {}
-
-   TaskInfo &operator=(TaskInfo &&other)  {
-      exec = std::move(other.exec);
-      dests = std::move(other.dests);
-      depth = other.depth;
-      num_deps = other.num_deps.load();
-      visiting = other.visiting;
-      return *this;
-   }
+   TaskInfo(TaskInfo&&) =delete;
+   TaskInfo &operator=(TaskInfo&&) =delete;
 
    void operator()() { exec(); }
 
-   void add_dep(TaskInfo *next) { 
-      auto valid = dests.insert(next); 
-      if (valid.second) {
-         next->num_deps++;
-      } 
-   }
-
    Executor exec; 
-   std::unordered_set<TaskInfo*> dests;
+   Successors dests;
+   size_t id; // position in the graph's node arena
    int depth;
+   int join_count; // number of dependencies when the graph was compiled, see Graph::seal
    std::atomic<int> num_deps;
-   bool visiting;
+   int branch; // successor picked by a condition task's last call, none if out of range
+   Topology *topology;
+   TaskInfo *parent; // task whose subflow this task belongs to
+   std::atomic<int> num_children; // unfinished children, plus one while running
+   std::unique_ptr<Graph, GraphDeleter> subgraph; // children spawned by the last run
+   // atomic since a coroutine task may be queued again while the worker that ran 
+   // its last step is still finishing it
+   std::atomic<uint64_t> ready_at; // when the task was last queued, if stats are counted
+   std::atomic<uint64_t> elapsed_ns; // duration of the last run, if stats or tracing are on
+   uint64_t cost; // estimated duration in any unit, 0 if none was given
+   uint8_t priority; // queue level, below num_priorities
+   bool sees_cancel; // called, with run_cancelled() true, when its run is cancelled
+   bool condition; // its edges are weak, only the successor it picks is run
+   std::string mname;
 };
 
 /* Wrapper for vertex node, public facing */
@@ -57,9 +92,21 @@ class Task {
 
       void operator()() { (*node)(); }
 
+      /* labels the task in error messages and reports */
+      Task &name(const std::string &label) { node->mname = label; return *this; }
+      const std::string &name() const { return node->mname; }
+
+      /* estimated duration of the task in any unit consistent across the graph, 
+      read by PriorityPolicy::estimates */
+      Task &cost(const uint64_t estimate) { node->cost = estimate; return *this; }
+
+      /* queue level the last ranking gave the task, 0 being the most urgent, see 
+      Scheduler::prioritize */
+      int priority() const { return node->priority; }
+
    private:
       TaskInfo *node;
-      friend class Scheduler;
+      friend class FlowBuilder;
 };
 
 }
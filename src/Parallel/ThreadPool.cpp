@@ -1,17 +1,79 @@
 #include "ThreadPool.hpp"
 #include <iostream>
+#include <algorithm>
+#include <fstream>
 
 namespace Parallel {
 
-Worker::Worker(ThreadPool *parent) : 
- employer{parent}, thread{Worker::work, this, parent} {}
+namespace {
+
+/* the worker running on this thread, if any */
+thread_local Worker *current = nullptr;
+
+/* set while a task of a cancelled run is called to observe the cancellation */
+thread_local bool cancelling = false;
+
+/* bounds on the number of fruitless steal rounds before parking. the limit 
+doubles when spinning finds work and halves when it does not */
+constexpr int min_spins = 16;
+constexpr int max_spins = 1024;
+
+/* hint to the core that this is a spin loop */
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+   __builtin_ia32_pause();
+#elif defined(__aarch64__)
+   asm volatile("yield");
+#endif
+}
+
+/* waits longer after each fruitless steal round, so idle thieves stop hammering
+the same victims, and gives up the cpu once the wait gets long */
+void backoff(const int round) {
+   const int pauses = 1 << std::min(round, 6);
+   for (int i = 0; i < pauses; i++) {
+      cpu_relax();
+   }
+   if (round >= 4) {
+      std::this_thread::yield();
+   }
+}
+
+}
+
+bool run_cancelled() {
+   return cancelling;
+}
+
+void Topology::wait() const {
+   if (pool != nullptr) {
+      pool->wait_until([this]() { return done(); });
+   }
+}
+
+void Topology::release() {
+   finished.store(true, std::memory_order_release);
+   if (pool != nullptr) {
+      pool->wake_waiters();
+   }
+}
+
+Worker::Worker(ThreadPool *parent, const int index, const CpuPlace &cpu, 
+ WorkerCounters *stats) : 
+ employer{parent}, num_near{0}, seed{static_cast<uint32_t>(index) * 0x9E3779B9u + 1}, 
+ counters{stats}, place{cpu}, id{index}, spin_limit{min_spins} {}
+
+void Worker::set_victims(std::vector<Worker*> &&order, const int near) {
+   victims = std::move(order);
+   num_near = near;
+}
 
 Worker::~Worker() {
    join();
 }
 
-void Worker::assign(TaskInfo *task) {
-   jobs.push(task);
+void Worker::start() {
+   thread = std::thread{&Worker::work, this};
 }
 
 void Worker::join() {
@@ -20,94 +82,526 @@ void Worker::join() {
    }
 }
 
-void Worker::work(ThreadPool *parent) {
-   while (!parent->running.load(std::memory_order_acquire)) {
-      std::unique_lock locker{parent->lck_dev};
-      parent->cond.wait(locker, [this, parent]() { 
-         return parent->running.load() || parent->done.load(); 
-      });
+void Worker::work() {
+   current = this;
+   if (place.cpu >= 0 && pin_thread(place.cpu)) {
+      // first touch from the pinned thread puts the rings on this cpu's node
+      for (auto &queue : jobs) {
+         queue.rehome();
+      }
    }
-   TaskInfo *task = nullptr;
-   while (parent->running.load() && !parent->done.load()) {
-      if (!jobs.empty()) {
-         pop_run(task);
-      } else {
-         steal_run(task);
+   while (!employer->done.load(std::memory_order_acquire)) {
+      if (!pop_run() && !steal_run()) {
+         wait_for_task();
+      }
+   }
+   current = nullptr;
+}
+
+/* the most urgent queued task first. only the owner pushes, so a level that looks
+empty here has nothing left to pop */
+bool Worker::pop_run() {
+   for (auto &queue : jobs) {
+      if (queue.empty()) {
+         continue;
+      }
+      TaskInfo *task = queue.pop();
+      if (task != nullptr) {
+         WorkerCounters::add(counters->pops);
+         run(task, Origin::popped);
+         return true;
       }
    }
+   return false;
 }
 
-void Worker::pop_run(TaskInfo *task) {
-   task = jobs.pop();
+bool Worker::steal_run() {
+   Origin origin = Origin::stolen;
+   TaskInfo *task = take_task(origin);
    if (task != nullptr) {
-      if (task->num_deps != 0) {
-         std::unique_lock locker{employer->lck_dev};
-         employer->cond.wait(locker, [task]() { return task->num_deps == 0; });
+      run(task, origin);
+      return true;
+   }
+   return false;
+}
+
+/* a task submitted from outside the pool first, otherwise one stolen from another 
+worker. origin is set to where the task came from */
+TaskInfo *Worker::take_task(Origin &origin) {
+   TaskInfo *task = employer->take_submitted();
+   origin = Origin::submitted;
+   if (task != nullptr) {
+      WorkerCounters::add(counters->submissions);
+   } else {
+      task = steal_task();
+      origin = Origin::stolen;
+      WorkerCounters::add((task != nullptr) ? counters->steals : counters->failed_steals);
+   }
+   return task;
+}
+
+TaskInfo *Worker::steal_task() {
+   const size_t count = victims.size();
+   TaskInfo *task = nullptr;
+   if (count == 0) {
+      return nullptr;
+   }
+   if (employer->policy == StealPolicy::nearest) {
+      for (auto it = victims.begin(); task == nullptr && it != victims.end(); ++it) {
+         task = take_from(*it);
+      }
+      return task;
+   }
+   task = take_from(victims[next_random() % num_near]);
+   const size_t offset = next_random() % count;
+   for (size_t i = 0; task == nullptr && i < count; i++) {
+      task = take_from(victims[(offset + i) % count]);
+   }
+   return task;
+}
+
+/* steals from the victim's most urgent nonempty level */
+TaskInfo *Worker::take_from(Worker *victim) {
+   for (int level = 0; level < num_priorities; level++) {
+      WorkStealingQueue &queue = victim->jobs[level];
+      if (queue.empty()) {
+         continue;
+      }
+      if (employer->policy != StealPolicy::batched) {
+         if (TaskInfo *task = queue.steal()) {
+            return task;
+         }
+         continue;
+      }
+      if (TaskInfo *task = queue.steal_half(jobs[level])) {
+         if (!jobs[level].empty()) {
+            // the rest of the batch can be stolen from here in turn
+            employer->notifier.notify_one();
+         }
+         return task;
+      }
+   }
+   return nullptr;
+}
+
+/* xorshift32 */
+uint32_t Worker::next_random() {
+   seed ^= seed << 13;
+   seed ^= seed >> 17;
+   seed ^= seed << 5;
+   return seed;
+}
+
+/* spins on steal attempts for a while, then parks until notified. returns false
+once the pool is done */
+bool Worker::wait_for_task() {
+   const uint64_t idle_from = WorkerCounters::stamp();
+   auto idle_until_now = [this, idle_from]() {
+      WorkerCounters::add(counters->idle_ns, WorkerCounters::stamp() - idle_from);
+   };
+   for (int i = 0; i < spin_limit; i++) {
+      Origin origin = Origin::stolen;
+      if (TaskInfo *task = take_task(origin)) {
+         // idle until the steal, the task's run is not
+         idle_until_now();
+         spin_limit = (spin_limit < max_spins) ? spin_limit * 2 : max_spins;
+         run(task, origin);
+         return true;
+      }
+      backoff(i);
+   }
+   spin_limit = (spin_limit > min_spins) ? spin_limit / 2 : min_spins;
+   Notifier &notifier = employer->notifier;
+   notifier.prepare_wait(id);
+   if (employer->done.load(std::memory_order_acquire)) {
+      notifier.cancel_wait(id);
+      idle_until_now();
+      return false;
+   }
+   for (auto &queue : jobs) {
+      queue.reclaim();
+   }
+   if (has_visible_task()) {
+      notifier.cancel_wait(id);
+      idle_until_now();
+      return true;
+   }
+   WorkerCounters::add(counters->parks);
+   notifier.commit_wait(id);
+   idle_until_now();
+   return !employer->done.load(std::memory_order_acquire);
+}
+
+bool Worker::has_visible_task() {
+   if (has_queued() || employer->num_submitted.load(std::memory_order_relaxed) != 0) {
+      return true;
+   }
+   for (Worker *victim : victims) {
+      if (victim->has_queued()) {
+         return true;
+      }
+   }
+   return false;
+}
+
+bool Worker::has_queued() const {
+   for (auto &queue : jobs) {
+      if (!queue.empty()) {
+         return true;
+      }
+   }
+   return false;
+}
+
+/* runs a ready task and releases its dependents. the most urgent dependent to become
+ready, the first of them on a tie, is run next on this thread in place of the 
+finished task, the rest are pushed onto this worker's queues for it to pop or for 
+others to steal. an exception thrown by a task is kept by its topology, which 
+cancels the run; the tasks of a cancelled run are completed without being called,
+so the rest of the graph drains quickly and every count stays consistent */
+void Worker::run(TaskInfo *task, Origin origin) {
+   while (task != nullptr) {
+      // every dependency has finished or a condition picked the task, rearm the count
+      task->num_deps.store(task->join_count, std::memory_order_relaxed);
+      Topology *topology = task->topology;
+      if (topology != nullptr && topology->is_cancelled()) {
+         skip(task);
+         task = complete(task);
+         origin = Origin::continued;
+         continue;
+      }
+      const bool traced = employer->tracing.load(std::memory_order_acquire);
+      const uint64_t started = traced ? TraceBuffer::now() : WorkerCounters::stamp();
+      const uint64_t ready_at = task->ready_at.load(std::memory_order_relaxed);
+      if (ready_at != 0) {
+         WorkerCounters::add(counters->wait_ns, started - ready_at);
+      }
+      try {
+         (*task)();
+      } catch (...) {
+         if (topology == nullptr) {
+            throw;
+         }
+         topology->fail(std::current_exception());
+      }
+      const uint64_t finished = traced ? TraceBuffer::now() : WorkerCounters::stamp();
+      if (traced) {
+         employer->traces[id].record(*task, origin, started, finished);
       }
+      task->elapsed_ns.store(finished - started, std::memory_order_relaxed);
+      if (topology == nullptr) {
+         // a forked job, done with the trace buffer
+         employer->num_jobs.fetch_sub(1, std::memory_order_release);
+      }
+      WorkerCounters::add(counters->exec_ns, finished - started);
+      WorkerCounters::add(counters->tasks);
+      task = complete(task);
+      origin = Origin::continued;
+   }
+}
+
+/* a skipped task is still called if it asked to see the cancellation. a skipped 
+condition picks no successor, so a loop ends with its run */
+void Worker::skip(TaskInfo *task) {
+   task->branch = -1;
+   if (!task->sees_cancel) {
+      return;
+   }
+   cancelling = true;
+   try {
       (*task)();
-      for (auto dep : task->dests) { 
-         dep->num_deps.fetch_sub(1, std::memory_order_release);
-      }
-      employer->cond.notify_all();
-   } 
-}
-
-void Worker::steal_run(TaskInfo *task) {
-   Worker *victim = sibling;
-   while (victim != this) {
-      if (!victim->jobs.empty()) {
-         task = victim->jobs.steal();
-         if (task != nullptr) {
-            if (task->num_deps != 0) { // impl a peek method, and maybe an empty check for all methods
-               std::unique_lock locker{employer->lck_dev};
-               employer->cond.wait(locker, [task]() { return task->num_deps == 0; });
-            }
-            (*task)();
-            for (auto dep : task->dests) { 
-               dep->num_deps.fetch_sub(1, std::memory_order_release);
+   } catch (...) {
+      // the run already failed or was cancelled, there is nothing left to report
+   }
+   cancelling = false;
+}
+
+/* a task is complete once it has returned and its subflow, if it spawned one, has 
+finished. completing the last child of a subflow completes the parent in turn. 
+returns the dependent to continue with, if any */
+TaskInfo *Worker::complete(TaskInfo *task) {
+   TaskInfo *next = nullptr;
+   while (task != nullptr) {
+      if (task->num_children.load(std::memory_order_acquire) != 0) {
+         const int left = task->num_children.fetch_sub(1, std::memory_order_acq_rel);
+         if (left != 1) {
+            if (left == 2) {
+               // only the task's own hold is left, wake a thread joining on it
+               employer->wake_waiters();
             }
-            employer->cond.notify_all();
-         } 
+            break; // the last child to finish completes the task
+         }
+      }
+      TaskInfo *parent = task->parent;
+      bool handed_off = false;
+      auto ready = [&](TaskInfo *dep) {
+         if (next == nullptr) {
+            next = dep;
+            next->ready_at.store(WorkerCounters::stamp(), std::memory_order_relaxed);
+            handed_off = true;
+         } else if (dep->priority < next->priority) {
+            submit(next);
+            next = dep;
+            next->ready_at.store(WorkerCounters::stamp(), std::memory_order_relaxed);
+         } else {
+            submit(dep);
+         }
+      };
+      if (task->condition) {
+         // the picked successor runs whatever its count, it is rearmed as it starts
+         if (task->branch >= 0 && static_cast<size_t>(task->branch) < task->dests.size()) {
+            ready(task->dests.begin()[task->branch]);
+         }
       } else {
+         for (auto dep : task->dests) { 
+            if (dep->num_deps.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+               ready(dep);
+            }
+         }
+      }
+      if (!handed_off && task->topology != nullptr) {
+         employer->retire(task);
+      }
+      task = parent;
+   }
+   return next;
+}
+
+/* queues a task that became ready during a run, or a job outside any graph */
+void Worker::submit(TaskInfo *task) {
+   task->ready_at.store(WorkerCounters::stamp(), std::memory_order_relaxed);
+   if (task->topology != nullptr) {
+      task->topology->in_flight.fetch_add(1, std::memory_order_relaxed);
+   }
+   jobs[task->priority].push(task);
+   employer->notifier.notify_one();
+}
+
+/* runs queued tasks until count drops to target, used by a task blocked on its 
+children so that the thread keeps working */
+void Worker::corun(const std::atomic<int> &count, const int target) {
+   while (count.load(std::memory_order_acquire) > target) {
+      if (!pop_run() && !steal_run()) {
          std::this_thread::yield();
-         victim = victim->sibling;
       }
    }
 }
 
-ThreadPool::ThreadPool(const int numthreads) : running{false}, done{false} {
-   workers.reserve(numthreads);
-   workers.emplace_back(this);
-   for (int i = 1; i < numthreads; i++) {
-      workers.emplace_back(this);
-      workers[i - 1].set_sibling(&workers[i]);
+Worker *Worker::this_worker() {
+   return current;
+}
+
+bool Worker::timed() const {
+   return stats_enabled || employer->tracing.load(std::memory_order_acquire);
+}
+
+ThreadPool::ThreadPool(const int numthreads, const Affinity affinity, 
+ const StealPolicy steal_policy) : 
+notifier{(numthreads > 0) ? numthreads : 1}, 
+counters{new WorkerCounters[(numthreads > 0) ? numthreads : 1]}, 
+baseline((numthreads > 0) ? numthreads : 1), tracing{false}, num_submitted{0}, num_runs{0}, 
+num_jobs{0}, num_outside{0}, wakeups{0}, done{false}, 
+policy{steal_policy} {
+   const int count = (numthreads > 0) ? numthreads : 1;
+   std::vector<CpuPlace> places;
+   if (affinity == Affinity::pinned) {
+      places = CpuTopology::detect().assign(count);
+   } else {
+      places.assign(count, CpuPlace{-1, -1, -1, -1, -1});
+   }
+   workers.reserve(count);
+   for (int i = 0; i < count; i++) {
+      workers.emplace_back(this, i, places[i], &counters[i]);
+   }
+   // nearest workers first, ties broken by ring order from the thief
+   for (int i = 0; i < count; i++) {
+      std::vector<Worker*> order;
+      for (int step = 1; step < count; step++) {
+         order.push_back(&workers[(i + step) % count]);
+      }
+      std::stable_sort(order.begin(), order.end(), [&](Worker *a, Worker *b) {
+         return CpuTopology::distance(places[i], a->place) < CpuTopology::distance(places[i], b->place);
+      });
+      int near = 0;
+      while (near < static_cast<int>(order.size()) && CpuTopology::distance(places[i], 
+       order[near]->place) == CpuTopology::distance(places[i], order[0]->place)) {
+         near++;
+      }
+      workers[i].set_victims(std::move(order), near);
+   }
+   for (auto &worker : workers) {
+      worker.start();
    }
-   workers[numthreads - 1].set_sibling(&workers[0]);
 }
 
 ThreadPool::~ThreadPool() {
+   wait_for_all();
+   io_service.reset();
+   while (num_outside.load(std::memory_order_acquire) != 0) {
+      std::this_thread::yield();
+   }
    done.store(true, std::memory_order_release);
-   running.store(false, std::memory_order_release);
-   cond.notify_all();
+   notifier.notify_all();
+   for (auto &worker : workers) {
+      worker.join();
+   }
 }
 
 void ThreadPool::dispatch(Topology &topology) {
-   int processor{};
-   int number_threads = workers.size();
-   for (int i = topology.size() - 1; i >= 0; i--) {
-      for (int j = 0; j < topology[i].size(); j++) {
-         workers[processor % number_threads].assign(topology[i][j]);
-         processor++;
+   if (topology.done()) {
+      throw std::logic_error{"dispatch() of a topology that was not claimed"};
+   }
+   if (topology.sources.empty()) {
+      topology.release();
+      throw std::logic_error{"dispatch() requires at least one ready task"};
+   }
+   num_runs.fetch_add(1, std::memory_order_relaxed);
+   topology.pool = this;
+   topology.started_ns = clock_ns();
+   topology.cancelled.store(false, std::memory_order_relaxed);
+   topology.take_error();
+   topology.completion.reset();
+   topology.rearm();
+   topology.in_flight.store(topology.sources.size(), std::memory_order_relaxed);
+   for (auto *task : topology.sources) {
+      schedule(task);
+   }
+}
+
+PoolStats ThreadPool::stats() const {
+   PoolStats snapshot;
+   for (size_t i = 0; i < workers.size(); i++) {
+      snapshot.workers.push_back(counters[i].snapshot() - baseline[i]);
+      snapshot.total += snapshot.workers.back();
+   }
+   return snapshot;
+}
+
+/* counters belong to their workers, so a reset moves the baseline rather than
+writing to them */
+void ThreadPool::reset_stats() {
+   for (size_t i = 0; i < workers.size(); i++) {
+      baseline[i] = counters[i].snapshot();
+   }
+}
+
+void ThreadPool::enable_tracing(const size_t events_per_worker) {
+   if (num_runs.load(std::memory_order_acquire) != 0 
+    || num_jobs.load(std::memory_order_acquire) != 0) {
+      throw std::logic_error{"enable_tracing() while a run or job is in progress"};
+   }
+   if (traces == nullptr) {
+      traces.reset(new TraceBuffer[workers.size()]);
+   }
+   for (size_t i = 0; i < workers.size(); i++) {
+      if (traces[i].capacity() != events_per_worker) {
+         traces[i].reserve(events_per_worker);
+      }
+      traces[i].clear();
+   }
+   tracing.store(true, std::memory_order_release);
+}
+
+void ThreadPool::disable_tracing() {
+   tracing.store(false, std::memory_order_release);
+}
+
+void ThreadPool::dump_trace(std::ostream &out) const {
+   std::vector<std::vector<TraceEvent>> events(workers.size());
+   if (traces != nullptr) {
+      for (size_t i = 0; i < workers.size(); i++) {
+         events[i] = traces[i].collect();
       }
    }
-   running.store(true, std::memory_order_release);
-   cond.notify_all();
+   write_trace(out, events);
+}
+
+bool ThreadPool::dump_trace(const std::string &path) const {
+   std::ofstream file{path};
+   if (!file) {
+      return false;
+   }
+   dump_trace(file);
+   return static_cast<bool>(file);
+}
+
+IoService &ThreadPool::io() {
+   std::call_once(io_once, [this]() { io_service = std::make_unique<IoService>(); });
+   return *io_service;
 }
 
 void ThreadPool::wait_for_all() {
-   for (int i = 0; i < workers.size(); i++) {
-      workers[i].join();
+   size_t runs = num_runs.load(std::memory_order_acquire);
+   while (runs != 0) {
+      num_runs.wait(runs, std::memory_order_acquire);
+      runs = num_runs.load(std::memory_order_acquire);
+   }
+}
+
+/* queues a ready task. a worker of this pool pushes onto its own deque, any other 
+thread hands the task over through the shared submission queue. such a thread may
+be waking a coroutine task whose run, once the task is queued, can finish and let 
+the pool be destroyed, so it holds the pool until it is done notifying */
+void ThreadPool::schedule(TaskInfo *task) {
+   task->ready_at.store(WorkerCounters::stamp(), std::memory_order_relaxed);
+   if (current != nullptr && current->employer == this) {
+      current->jobs[task->priority].push(task);
+      notifier.notify_one();
+      return;
+   }
+   num_outside.fetch_add(1, std::memory_order_relaxed);
+   {
+      std::lock_guard locker{lck_submit};
+      submitted.push_back(task);
+      num_submitted.fetch_add(1, std::memory_order_relaxed);
    }
+   notifier.notify_one();
+   num_outside.fetch_sub(1, std::memory_order_release);
 }
 
-}
\ No newline at end of file
+void ThreadPool::wake_waiters() {
+   wakeups.fetch_add(1, std::memory_order_seq_cst);
+   wakeups.notify_all();
+}
+
+TaskInfo *ThreadPool::take_submitted() {
+   if (num_submitted.load(std::memory_order_relaxed) == 0) {
+      return nullptr;
+   }
+   std::lock_guard locker{lck_submit};
+   if (submitted.empty()) {
+      return nullptr;
+   }
+   TaskInfo *task = submitted.front();
+   submitted.pop_front();
+   num_submitted.fetch_sub(1, std::memory_order_relaxed);
+   return task;
+}
+
+/* called once per finished task that did not hand its slot to a dependent */
+void ThreadPool::retire(TaskInfo *task) {
+   Topology *topology = task->topology;
+   if (topology->in_flight.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      topology->finished_ns = clock_ns();
+      if (!topology->is_cancelled() && topology->repeat()) {
+         topology->started_ns = topology->finished_ns;
+         topology->rearm();
+         topology->in_flight.store(topology->sources.size(), std::memory_order_relaxed);
+         for (auto *source : topology->sources) {
+            schedule(source);
+         }
+         return;
+      }
+      // the graph may be destroyed once finished is set, so its waiters are taken first
+      // and wait() sleeps on the pool's word
+      Event::Awaiter *waiting = topology->completion.release();
+      topology->finished.store(true, std::memory_order_release);
+      wake_waiters();
+      Event::wake_all(waiting);
+      if (num_runs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+         num_runs.notify_all();
+      }
+   }
+}
+
+}
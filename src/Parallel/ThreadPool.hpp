@@ -2,53 +2,169 @@
 #define THREADPOOLHPP
 
 #include <thread>
-#include <condition_variable>
-#include <mutex>
 #include <cstdio>
 #include <atomic>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <array>
 
 #include "Task.hpp"
+#include "Topology.hpp"
 #include "WorkStealingQueue.hpp"
+#include "Notifier.hpp"
+#include "Affinity.hpp"
+#include "Stats.hpp"
+#include "Trace.hpp"
+#include "IoService.hpp"
 
 namespace Parallel {
 
 class Worker;
-using Topology = std::vector<std::vector<TaskInfo*>>;
 
+/* how an idle worker picks a victim. nearest probes the other workers in order of 
+distance and takes one task. randomized starts with a random victim among the 
+nearest, then probes every worker from a random offset. batched picks victims as 
+randomized does, and also moves up to half of the victim's queue into its own */
+enum class StealPolicy { nearest, randomized, batched };
+
+/* long-lived set of workers. runs of any number of graphs may be dispatched to the
+pool, concurrently or one after another, and the threads live until the pool does.
+pinned workers each stay on one of the cpus the process may use, and try to steal 
+from the workers nearest them in the cache hierarchy first */
 class ThreadPool {
    friend class Worker; 
+   friend class JobGroup;
+   friend class CoroutineFrame;
+   friend class Topology;
    public:
-      ThreadPool(const int numthreads = std::thread::hardware_concurrency() - 1);
+      ThreadPool(const int numthreads = std::thread::hardware_concurrency() - 1,
+         const Affinity affinity = Affinity::floating, 
+         const StealPolicy steal_policy = StealPolicy::nearest);
       ~ThreadPool();
+      ThreadPool(ThreadPool&) =delete;
+      ThreadPool &operator=(ThreadPool&) =delete;
+
+      /* starts a run from the ready tasks of a compiled graph, the rest are scheduled 
+      by the workers as their dependencies complete. the topology must have been 
+      claimed for the run, see Topology::claim */
       void dispatch(Topology &topology);
+
+      /* waits for every run dispatched so far to finish */
       void wait_for_all();
+
+      int size() const { return static_cast<int>(workers.size()); }
+
+      /* counters of every worker since the last reset, read while the workers run. 
+      all zero when built without PARALLEL_STATS */
+      PoolStats stats() const;
+      void reset_stats();
+
+      /* records the start and end of every task, the worker that ran it and how the
+      worker got it, keeping the last events_per_worker events of each worker. 
+      tracing may only be switched on while no run or forked job is in progress */
+      void enable_tracing(const size_t events_per_worker = 1 << 16);
+      void disable_tracing();
+
+      /* writes the recorded events as Chrome trace-event JSON. call once the traced
+      runs have finished. false if the file cannot be written */
+      void dump_trace(std::ostream &out) const;
+      bool dump_trace(const std::string &path) const;
+
+      /* the service running the I/O requests of this pool's coroutine tasks, made 
+      on first use */
+      IoService &io();
    private:
+      void schedule(TaskInfo *task);
+      void retire(TaskInfo *task);
+      TaskInfo *take_submitted();
+
+      /* threads off the pool waiting for a run or a job group to finish sleep on 
+      the pool's word rather than on the state they wait for, since that state may
+      be destroyed as soon as the waiter sees it change */
+      template<typename Pred>
+      void wait_until(Pred ready);
+      void wake_waiters();
+
+      Notifier notifier;
+      std::unique_ptr<WorkerCounters[]> counters;
+      std::vector<WorkerStats> baseline;
+      std::unique_ptr<TraceBuffer[]> traces;
+      std::atomic<bool> tracing;
       std::vector<Worker> workers; 
-      std::condition_variable cond;
-      std::mutex lck_dev;
-      std::atomic<bool> running;
+      std::mutex lck_submit;
+      std::deque<TaskInfo*> submitted;
+      std::atomic<size_t> num_submitted;
+      std::atomic<size_t> num_runs;
+      std::atomic<size_t> num_jobs; // forked by job groups and not yet done running
+      std::atomic<int> num_outside; // threads off the pool inside schedule()
+      std::atomic<uint32_t> wakeups; // bumped by wake_waiters()
       std::atomic<bool> done;
+      StealPolicy policy;
+      std::once_flag io_once;
+      std::unique_ptr<IoService> io_service;
 };
 
 class Worker {
    public:
-      Worker(ThreadPool*);
+      Worker(ThreadPool*, const int, const CpuPlace&, WorkerCounters*);
       Worker(Worker&) =delete;
       Worker(Worker&&) =default;
       ~Worker();
-      void set_sibling(Worker *next) { sibling = next; }
-      void assign(TaskInfo *task);
+      void set_victims(std::vector<Worker*> &&order, const int near);
+      void start();
       void join();
+
+      /* the worker running on the calling thread, null off the pool */
+      static Worker *this_worker();
+      ThreadPool *pool() const { return employer; }
+
+      /* true if the tasks this worker runs are timed, with stats counted or tracing on */
+      bool timed() const;
    private:
-      void work(ThreadPool*);
-      void pop_run(TaskInfo*);
-      void steal_run(TaskInfo*);
-      std::thread thread;
-      WorkStealingQueue jobs;
+      void work();
+      bool pop_run();
+      bool steal_run();
+      TaskInfo *take_task(Origin &origin);
+      TaskInfo *steal_task();
+      TaskInfo *take_from(Worker *victim);
+      uint32_t next_random();
+      bool wait_for_task();
+      bool has_visible_task();
+      void run(TaskInfo*, Origin);
+      void skip(TaskInfo*);
+      TaskInfo *complete(TaskInfo*);
+      void submit(TaskInfo*);
+      void corun(const std::atomic<int> &count, const int target);
+      bool has_queued() const;
+      std::array<WorkStealingQueue, num_priorities> jobs; // one deque per priority
       ThreadPool *employer;
-      Worker *sibling;
+      std::vector<Worker*> victims; // other workers, nearest first
+      int num_near; // victims sharing the smallest distance
+      uint32_t seed;
+      WorkerCounters *counters;
+      CpuPlace place; // cpu is -1 for a floating worker
+      int id;
+      int spin_limit;
+      std::thread thread;
+      friend class ThreadPool;
+      friend class Subflow;
+      friend class JobGroup;
+      friend class CoroutineFrame;
 };
 
+/* Implementation */
+
+template<typename Pred>
+void ThreadPool::wait_until(Pred ready) {
+   uint32_t seen = wakeups.load(std::memory_order_seq_cst);
+   while (!ready()) {
+      wakeups.wait(seen, std::memory_order_seq_cst);
+      seen = wakeups.load(std::memory_order_seq_cst);
+   }
+}
+
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,123 @@
+#ifndef TOPOLOGYHPP
+#define TOPOLOGYHPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <functional>
+#include <exception>
+#include <mutex>
+#include <utility>
+
+#include "Task.hpp"
+#include "Coroutine.hpp"
+
+namespace Parallel {
+
+class ThreadPool;
+
+/* compiled form of a task graph and the state of its runs on a ThreadPool. tracks 
+the tasks of the current run that are queued or executing; once none are left the 
+run is over, and either the graph is run again or the topology is finished */
+class Topology {
+   public:
+      Topology() : in_flight{0}, finished{true}, cancelled{false}, completion{true}, 
+         outer{nullptr}, pool{nullptr}, repeats{0}, started_ns{0}, finished_ns{0} {}
+      Topology(Topology&) =delete;
+      Topology &operator=(Topology&) =delete;
+
+      /* blocks until the run finishes */
+      void wait() const;
+      bool done() const { return finished.load(std::memory_order_acquire); }
+
+      /* wall time of the last finished run */
+      uint64_t makespan_ns() const { return finished_ns - started_ns; }
+
+      /* stops the run in progress: tasks already running finish, the rest of the 
+      run is skipped and a repeating run does not repeat. a run started by a module
+      task is cancelled along with the run of the graph holding the module */
+      void cancel() { cancelled.store(true, std::memory_order_release); }
+      bool is_cancelled() const {
+         return cancelled.load(std::memory_order_acquire) 
+            || (outer != nullptr && outer->is_cancelled());
+      }
+
+      /* the first exception thrown by a task of the last run, cleared by taking it */
+      std::exception_ptr take_error() {
+         std::lock_guard locker{lck_error};
+         return std::exchange(error, nullptr);
+      }
+   private:
+      /* marks the topology running before its run is prepared, false if a run is
+      already in progress, so two threads starting the graph cannot both run it */
+      bool claim() {
+         bool idle = true;
+         return finished.compare_exchange_strong(idle, false, std::memory_order_acq_rel);
+      }
+
+      /* gives up a claim that did not lead to a run, waking anyone waiting on it */
+      void release();
+
+      /* records a task's exception, the first one is kept, and cancels the run */
+      void fail(std::exception_ptr thrown) {
+         {
+            std::lock_guard locker{lck_error};
+            if (error == nullptr) {
+               error = std::move(thrown);
+            }
+         }
+         cancel();
+      }
+
+      /* a run of a graph with condition tasks may end with tasks that were never 
+      reached partly counted down, so their counts are reset before the next one */
+      void rearm() {
+         for (TaskInfo *node : rearmed) {
+            node->num_deps.store(node->join_count, std::memory_order_relaxed);
+         }
+      }
+
+      /* called by the worker that ends a run, true if the graph should run again */
+      bool repeat() {
+         if (predicate) {
+            return !predicate();
+         }
+         return --repeats > 0;
+      }
+
+      std::atomic<size_t> in_flight;
+      std::atomic<bool> finished;
+      std::atomic<bool> cancelled;
+      std::mutex lck_error;
+      std::exception_ptr error;
+      Event completion; // set along with finished, for coroutines to await
+      Topology *outer; // run of the graph whose module task started this run, if any
+      ThreadPool *pool; // pool of the last run, whose word wait() sleeps on
+      std::vector<TaskInfo*> sources;
+      std::vector<TaskInfo*> rearmed; // tasks with dependencies, if the graph has conditions
+      size_t repeats;
+      std::function<bool()> predicate;
+      uint64_t started_ns;
+      uint64_t finished_ns;
+      friend class ThreadPool;
+      friend class Worker;
+      friend class Scheduler;
+};
+
+/* cancels the runs of one graph from any thread, see Topology::cancel. tasks may 
+hold a copy to check whether their own run was cancelled and return early. valid
+as long as the graph's Scheduler */
+class CancellationToken {
+   public:
+      CancellationToken(Topology &topology) : topology{&topology} {}
+
+      void cancel() const { topology->cancel(); }
+      bool cancelled() const { return topology->is_cancelled(); }
+   private:
+      Topology *topology;
+};
+
+}
+
+#endif
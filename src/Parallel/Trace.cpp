@@ -0,0 +1,111 @@
+#include "Trace.hpp"
+#include "Task.hpp"
+#include "Stats.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+namespace Parallel {
+
+namespace {
+
+const char *origin_name(const Origin origin) {
+   switch (origin) {
+      case Origin::popped: return "popped";
+      case Origin::stolen: return "stolen";
+      case Origin::submitted: return "submitted";
+      case Origin::continued: return "continued";
+   }
+   return "unknown";
+}
+
+void write_escaped(std::ostream &out, const char *text) {
+   for (; *text != '\0'; text++) {
+      const unsigned char c = static_cast<unsigned char>(*text);
+      if (c == '"' || c == '\\') {
+         out << '\\' << *text;
+      } else if (c < 0x20) {
+         char code[8];
+         std::snprintf(code, sizeof(code), "\\u%04x", c);
+         out << code;
+      } else {
+         out << *text;
+      }
+   }
+}
+
+/* microseconds with the nanosecond remainder, the unit trace viewers expect */
+void write_micros(std::ostream &out, const uint64_t ns) {
+   char text[32];
+   std::snprintf(text, sizeof(text), "%llu.%03llu",
+      static_cast<unsigned long long>(ns / 1000), static_cast<unsigned long long>(ns % 1000));
+   out << text;
+}
+
+}
+
+uint64_t TraceBuffer::now() {
+   return clock_ns();
+}
+
+void TraceBuffer::record(const TaskInfo &task, const Origin origin, const uint64_t begin,
+ const uint64_t end) {
+   if (events.empty()) {
+      return;
+   }
+   const uint64_t at = head.load(std::memory_order_relaxed);
+   TraceEvent &event = events[at % events.size()];
+   event.begin_ns = begin;
+   event.end_ns = end;
+   event.id = task.id;
+   event.origin = origin;
+   const size_t length = std::min(task.mname.size(), sizeof(event.name) - 1);
+   std::memcpy(event.name, task.mname.data(), length);
+   event.name[length] = '\0';
+   head.store(at + 1, std::memory_order_release);
+}
+
+std::vector<TraceEvent> TraceBuffer::collect() const {
+   const uint64_t last = head.load(std::memory_order_acquire);
+   const uint64_t kept = std::min<uint64_t>(last, events.size());
+   std::vector<TraceEvent> out;
+   out.reserve(kept);
+   for (uint64_t i = last - kept; i < last; i++) {
+      out.push_back(events[i % events.size()]);
+   }
+   return out;
+}
+
+void write_trace(std::ostream &out, const std::vector<std::vector<TraceEvent>> &workers) {
+   uint64_t origin_ns = UINT64_MAX;
+   for (auto &events : workers) {
+      for (auto &event : events) {
+         origin_ns = std::min(origin_ns, event.begin_ns);
+      }
+   }
+   out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+   bool first = true;
+   for (size_t tid = 0; tid < workers.size(); tid++) {
+      out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":"
+         << tid << ",\"args\":{\"name\":\"worker " << tid << "\"}}";
+      first = false;
+      for (auto &event : workers[tid]) {
+         out << ",\n{\"name\":\"";
+         if (event.name[0] != '\0') {
+            write_escaped(out, event.name);
+         } else {
+            out << '#' << event.id;
+         }
+         out << "\",\"cat\":\"" << origin_name(event.origin) << "\",\"ph\":\"X\",\"ts\":";
+         write_micros(out, event.begin_ns - origin_ns);
+         out << ",\"dur\":";
+         write_micros(out, event.end_ns - event.begin_ns);
+         out << ",\"pid\":0,\"tid\":" << tid << ",\"args\":{\"id\":" << event.id
+            << ",\"origin\":\"" << origin_name(event.origin) << "\"}}";
+      }
+   }
+   out << "\n]}\n";
+}
+
+}
@@ -0,0 +1,61 @@
+#ifndef TRACEHPP
+#define TRACEHPP
+
+#include <atomic>
+#include <vector>
+#include <string>
+#include <ostream>
+#include <cstdint>
+#include <cstddef>
+
+namespace Parallel {
+
+struct TaskInfo;
+
+/* how a worker came by the task it ran */
+enum class Origin : uint8_t { popped, stolen, submitted, continued };
+
+/* one task execution. names are truncated copies, so events outlive their graph */
+struct TraceEvent {
+   uint64_t begin_ns;
+   uint64_t end_ns;
+   size_t id;
+   Origin origin;
+   char name[23];
+};
+
+/* the most recent events of one worker. only the worker records, and a reader
+sees every event published before it loaded the head; events recorded while a
+reader copies may overwrite the oldest ones it is copying, so the buffer should
+be read while its worker is idle */
+class alignas(64) TraceBuffer {
+   public:
+      TraceBuffer() : head{0} {}
+      TraceBuffer(TraceBuffer&) =delete;
+      TraceBuffer &operator=(TraceBuffer&) =delete;
+
+      void reserve(const size_t capacity) { events.resize(capacity); }
+      size_t capacity() const { return events.size(); }
+
+      /* owner only */
+      void record(const TaskInfo &task, const Origin origin, const uint64_t begin,
+         const uint64_t end);
+
+      /* retained events, oldest first */
+      std::vector<TraceEvent> collect() const;
+
+      void clear() { head.store(0, std::memory_order_release); }
+
+      static uint64_t now();
+   private:
+      std::vector<TraceEvent> events;
+      std::atomic<uint64_t> head;
+};
+
+/* writes the events of each worker, tid being the worker's index, as Chrome
+trace-event JSON, which chrome://tracing and Perfetto load */
+void write_trace(std::ostream &out, const std::vector<std::vector<TraceEvent>> &workers);
+
+}
+
+#endif
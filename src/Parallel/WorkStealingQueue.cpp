@@ -1,105 +1,172 @@
 #include "WorkStealingQueue.hpp"
 
-#define COMPILER_BARRIER asm volatile("" ::: "memory")
-#define MEMORY_BARRIER asm volatile("mfence" ::: "memory")
+#include <algorithm>
 
 namespace Parallel {
 
 WorkStealingQueue::WorkStealingQueue(const int buf_size) : 
-buffer{new TaskInfo*[buf_size]}, mask{buf_size - 1}, front{0}, back{0} {
-   if (buf_size & mask != 0) {
+front{0}, stealers{0}, back{0}, buffer{nullptr}, min_capacity{buf_size} {
+   if (buf_size <= 0 || (buf_size & (buf_size - 1)) != 0) {
       throw std::logic_error{"WorkStealingQueue buffer size must be a power of 2"};
    }
+   buffer.store(new Ring{buf_size}, std::memory_order_relaxed);
 }
 
 WorkStealingQueue::~WorkStealingQueue() {
-   delete[] buffer;
+   delete buffer.load(std::memory_order_relaxed);
 }
 
 WorkStealingQueue::WorkStealingQueue(WorkStealingQueue &&other) : 
-buffer{other.buffer}, mask{other.mask}, front{other.front.load()}, 
-back{other.back.load()} {}
+front{other.front.load()}, stealers{0}, back{other.back.load()}, buffer{other.buffer.load()}, 
+min_capacity{other.min_capacity}, retired{std::move(other.retired)} {
+   other.buffer.store(nullptr);
+   other.front.store(0);
+   other.back.store(0);
+}
 
 WorkStealingQueue &WorkStealingQueue::operator=(WorkStealingQueue &&other) {
    if (&other != this) { 
-      buffer = other.buffer;
-      mask = other.mask;
+      delete buffer.load();
+      buffer.store(other.buffer.load());
       front.store(other.front.load());
       back.store(other.back.load());
+      min_capacity = other.min_capacity;
+      retired = std::move(other.retired);
+      other.buffer.store(nullptr);
+      other.front.store(0);
+      other.back.store(0);
    }
    return *this;
 }
 
-bool WorkStealingQueue::push(TaskInfo *val) {
-   if (!full()) {
-      size_t b = back.load(std::memory_order_acquire);
-      buffer[b & mask] = val;
-      COMPILER_BARRIER;
-      back.store(b + 1, std::memory_order_release);
-      return true;
+void WorkStealingQueue::push(TaskInfo *val) {
+   int64_t b = back.load(std::memory_order_relaxed);
+   int64_t f = front.load(std::memory_order_acquire);
+   Ring *ring = buffer.load(std::memory_order_relaxed);
+   if (b - f > ring->capacity - 1) {
+      ring = resize(ring, f, b, ring->capacity * 2);
    }
-   return false;
+   ring->store(b, val);
+   // publishes the task, and whatever its pusher wrote to it, to thieves
+   back.store(b + 1, std::memory_order_release);
 }
 
 TaskInfo *WorkStealingQueue::pop() {
-   size_t b = back.load(std::memory_order_acquire) - 1;
-   back.store(b, std::memory_order_release);
-   MEMORY_BARRIER;
-   size_t f = front.load(std::memory_order_acquire);
+   int64_t b = back.load(std::memory_order_relaxed) - 1;
+   Ring *ring = buffer.load(std::memory_order_relaxed);
+   back.store(b, std::memory_order_relaxed);
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+   int64_t f = front.load(std::memory_order_relaxed);
+   TaskInfo *task = nullptr;
    if (f <= b) {
-      TaskInfo *task = buffer[b & mask];
-      if (f != b) {
-         return task;
-      } 
-      if (!front.compare_exchange_strong(f, f + 1)) {
-         task = nullptr;
+      task = ring->load(b);
+      if (f == b) {
+         // last task, race thieves for it
+         if (!front.compare_exchange_strong(f, f + 1, 
+          std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            task = nullptr;
+         }
+         back.store(b + 1, std::memory_order_relaxed);
+      } else if (ring->capacity > min_capacity && b - f < ring->capacity / 4) {
+         resize(ring, f, b, ring->capacity / 2);
       }
-      back.store(f + 1, std::memory_order_release);
-      return task;
    } else {
-      back.store(f, std::memory_order_release);
-      return nullptr;
+      back.store(b + 1, std::memory_order_relaxed);
    }
+   return task;
 } 
 
 TaskInfo *WorkStealingQueue::steal() {
-   size_t f = front.load(std::memory_order_acquire);
-   COMPILER_BARRIER;
-   if (f < back.load(std::memory_order_acquire)) {
-      TaskInfo *task = buffer[f & mask];
-      if (front.compare_exchange_strong(f, f + 1)) {
+   int64_t f = front.load(std::memory_order_acquire);
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+   int64_t b = back.load(std::memory_order_acquire);
+   if (f < b) {
+      stealers.fetch_add(1, std::memory_order_seq_cst);
+      Ring *ring = buffer.load(std::memory_order_seq_cst);
+      TaskInfo *task = ring->load(f);
+      bool taken = front.compare_exchange_strong(f, f + 1, 
+       std::memory_order_seq_cst, std::memory_order_relaxed);
+      stealers.fetch_sub(1, std::memory_order_release);
+      if (taken) {
          return task;
       }
    }
    return nullptr;
 }
 
+/* each task is claimed by its own CAS on front. claiming a range with one CAS 
+would race the owner's pop, which takes the back task without a CAS while other 
+tasks remain */
+TaskInfo *WorkStealingQueue::steal_half(WorkStealingQueue &thief) {
+   TaskInfo *task = steal();
+   if (task == nullptr) {
+      return nullptr;
+   }
+   for (int extra = std::min(size() / 2, max_batch); extra > 0; extra--) {
+      TaskInfo *more = steal();
+      if (more == nullptr) {
+         break;
+      }
+      thief.push(more);
+   }
+   return task;
+}
+
 TaskInfo *WorkStealingQueue::peek_front() {
-   if (!empty()) {
-      return buffer[front.load(std::memory_order_acquire) & mask];
+   TaskInfo *task = nullptr;
+   int64_t f = front.load(std::memory_order_acquire);
+   if (f < back.load(std::memory_order_acquire)) {
+      stealers.fetch_add(1, std::memory_order_seq_cst);
+      task = buffer.load(std::memory_order_seq_cst)->load(f);
+      stealers.fetch_sub(1, std::memory_order_release);
+   }
+   return task;
+}
+
+/* a thief announces itself before loading the ring, so once the owner has swapped
+rings and then sees no thieves, every later thief will load the current ring */
+void WorkStealingQueue::reclaim() {
+   if (!retired.empty() && stealers.load(std::memory_order_seq_cst) == 0) {
+      retired.clear();
    }
-   return nullptr;
+}
+
+void WorkStealingQueue::rehome() {
+   Ring *ring = buffer.load(std::memory_order_relaxed);
+   resize(ring, front.load(std::memory_order_acquire), back.load(std::memory_order_relaxed), 
+      ring->capacity);
 }
 
 void WorkStealingQueue::clear() {
    front.store(0);
    back.store(0);
+   retired.clear();
 }
 
 bool WorkStealingQueue::empty() const {
-   return front >= back;
+   return back.load(std::memory_order_relaxed) <= front.load(std::memory_order_relaxed);
 }
 
-bool WorkStealingQueue::full() const {
-   return back - front == mask + 1;
+int WorkStealingQueue::size() const {
+   int64_t count = back.load(std::memory_order_relaxed) - front.load(std::memory_order_relaxed);
+   return count > 0 ? static_cast<int>(count) : 0;
 }
 
-int WorkStealingQueue::size() {
-   return back - front;
+int WorkStealingQueue::capacity() const {
+   return static_cast<int>(buffer.load(std::memory_order_relaxed)->capacity);
 }
 
-const int WorkStealingQueue::size() const {
-   return back - front;
+/* copies the live range [f, b) into a new ring of the given capacity and publishes 
+it. the old ring is kept alive while thieves may have loaded it before the swap */
+WorkStealingQueue::Ring *WorkStealingQueue::resize(Ring *ring, int64_t f, int64_t b, int64_t cap) {
+   Ring *next = new Ring{cap};
+   for (int64_t i = f; i < b; i++) {
+      next->store(i, ring->load(i));
+   }
+   retired.emplace_back(ring);
+   buffer.store(next, std::memory_order_seq_cst);
+   reclaim();
+   return next;
 }
 
-}
\ No newline at end of file
+}
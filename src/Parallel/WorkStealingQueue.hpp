@@ -3,6 +3,8 @@
 
 #include <atomic>
 #include <memory>
+#include <vector>
+#include <cstdint>
 
 #include "Errors.hpp"
 #include "Task.hpp"
@@ -11,7 +13,13 @@ namespace Parallel {
 
 constexpr static int cache_size = 64;
 constexpr static int bs = 32768;
+constexpr static int max_batch = 64;
 
+/* single-owner, multi-thief deque (Chase-Lev). the owner pushes and pops at the 
+back, thieves steal from the front. the ring grows when full and shrinks when 
+mostly empty; replaced rings are retired rather than freed, since a thief may 
+still be reading from one, and are released by the owner once no steal is in 
+progress */
 class WorkStealingQueue {
    public: 
       WorkStealingQueue(const int buf_size = 32);
@@ -21,21 +29,57 @@ class WorkStealingQueue {
       WorkStealingQueue(WorkStealingQueue&&);
       WorkStealingQueue &operator=(WorkStealingQueue&&);
 
-      bool push(TaskInfo *val);
+      /* owner only */
+      void push(TaskInfo *val);
       TaskInfo *pop();
+
+      /* any thread */
       TaskInfo *steal();
       TaskInfo *peek_front();
+
+      /* steals a task to return, then moves up to half of what is left onto thief,
+      which the calling thread must own */
+      TaskInfo *steal_half(WorkStealingQueue &thief);
+
+      /* owner only, frees retired rings if no thief can be reading them */
+      void reclaim();
+
+      /* owner only, moves the queued tasks to a ring allocated and first touched by
+      the calling thread, so the ring lands on that thread's NUMA node */
+      void rehome();
+
+      /* owner only, and only while no thread can be stealing */
       void clear();
+
       bool empty() const;
-      bool full() const;
-      int size();
-      const int size() const;
+      int size() const;
+      int capacity() const;
 
    private:
-      alignas(cache_size) TaskInfo **buffer;
-      int mask;
-      std::atomic<size_t> front;
-      std::atomic<size_t> back;
+      struct Ring {
+         Ring(const int64_t cap) : capacity{cap}, mask{cap - 1}, 
+          slots{new std::atomic<TaskInfo*>[cap]} {}
+
+         void store(int64_t index, TaskInfo *task) { 
+            slots[index & mask].store(task, std::memory_order_relaxed); 
+         }
+         TaskInfo *load(int64_t index) const { 
+            return slots[index & mask].load(std::memory_order_relaxed); 
+         }
+
+         int64_t capacity;
+         int64_t mask;
+         std::unique_ptr<std::atomic<TaskInfo*>[]> slots;
+      };
+
+      Ring *resize(Ring *ring, int64_t f, int64_t b, int64_t cap);
+
+      alignas(cache_size) std::atomic<int64_t> front;
+      std::atomic<int> stealers;
+      alignas(cache_size) std::atomic<int64_t> back;
+      alignas(cache_size) std::atomic<Ring*> buffer;
+      int64_t min_capacity;
+      std::vector<std::unique_ptr<Ring>> retired;
 };
 
 }
@@ -0,0 +1,189 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <numeric>
+#include <stdexcept>
+#include <cstdlib>
+
+#include "../src/Parallel/Scheduler.hpp"
+
+/* checks the parallel algorithms against serial loops over empty, single, prime
+and large ranges, with integer and iterator ranges, strings as values, and from
+inside a graph task. exits with 1 on the first failed check */
+
+using namespace Parallel;
+
+namespace Test {
+
+void check(const bool passed, const char *caller, const std::string &what) {
+   if (!passed) {
+      std::cerr << "ERROR - " << caller << "()\n";
+      std::cerr << "-----------------------------\n";
+      std::cerr << what << '\n';
+      std::exit(1);
+   }
+}
+
+void passed(const char *caller) {
+   std::cout << caller << "() PASSED\n";
+}
+
+const std::vector<size_t> sizes = {0, 1, 9, 97, 1031, 100003};
+
+/* a scan of strings holds every prefix, so string ranges stay short */
+const std::vector<size_t> text_sizes = {0, 1, 9, 97, 1031};
+
+std::vector<std::string> words(const size_t count) {
+   std::vector<std::string> text(count);
+   for (size_t i = 0; i < count; i++) {
+      text[i] = std::string(1, static_cast<char>('a' + i % 26));
+   }
+   return text;
+}
+
+/* every index and every element visited exactly once */
+void for_each_index(ThreadPool &pool) {
+   for (const size_t count : sizes) {
+      std::vector<std::atomic<int>> hits(count);
+      parallel_for(pool, size_t{0}, count, [&hits](size_t i) { hits[i]++; });
+      for (size_t i = 0; i < count; i++) {
+         check(hits[i] == 1, __func__, "index " + std::to_string(i) + " of "
+            + std::to_string(count) + " visited " + std::to_string(hits[i].load()) + " times");
+      }
+      std::vector<long> values(count, 1);
+      parallel_for(pool, values.begin(), values.end(), [](long &value) { value *= 3; }, 7);
+      check(std::accumulate(values.begin(), values.end(), 0L) == static_cast<long>(3 * count),
+         __func__, "iterator range of " + std::to_string(count) + " not fully visited");
+   }
+   passed(__func__);
+}
+
+void transform(ThreadPool &pool) {
+   for (const size_t count : text_sizes) {
+      const std::vector<std::string> in = words(count);
+      std::vector<std::string> out(count);
+      parallel_transform(pool, in.begin(), in.end(), out.begin(),
+         [](const std::string &word) { return word + word; });
+      for (size_t i = 0; i < count; i++) {
+         check(out[i] == in[i] + in[i], __func__, "element " + std::to_string(i) + " of "
+            + std::to_string(count) + " is " + out[i]);
+      }
+   }
+   passed(__func__);
+}
+
+/* concatenation is associative but not commutative, so the order is checked too */
+void reduce(ThreadPool &pool) {
+   for (const size_t count : text_sizes) {
+      const std::vector<std::string> in = words(count);
+      const std::string serial = std::accumulate(in.begin(), in.end(), std::string{">"});
+      const std::string got = parallel_reduce(pool, in.begin(), in.end(), std::string{">"},
+         [](std::string a, const std::string &b) { return a + b; });
+      check(got == serial, __func__, "reduce of " + std::to_string(count) + " words differs");
+   }
+   for (const size_t count : sizes) {
+      const long sum = parallel_reduce(pool, 0L, static_cast<long>(count), 0L,
+         [](long a, long b) { return a + b; }, 5);
+      check(sum == static_cast<long>(count * (count - 1) / 2), __func__,
+         "sum of " + std::to_string(count) + " indices is " + std::to_string(sum));
+   }
+   passed(__func__);
+}
+
+/* counts that are not a multiple of the blocks the scan splits into, on pools of
+several sizes, so the last blocks are short */
+void scan(ThreadPool &pool) {
+   for (const size_t count : text_sizes) {
+      const std::vector<std::string> in = words(count);
+      std::vector<std::string> out(count);
+      parallel_scan(pool, in.begin(), in.end(), out.begin(),
+         [](std::string a, const std::string &b) { return a + b; });
+      std::string serial;
+      for (size_t i = 0; i < count; i++) {
+         serial += in[i];
+         check(out[i] == serial, __func__, "prefix " + std::to_string(i) + " of "
+            + std::to_string(count) + " words differs");
+      }
+   }
+   for (const size_t count : sizes) {
+      std::vector<long> values(count);
+      std::iota(values.begin(), values.end(), 1L);
+      parallel_scan(pool, values.begin(), values.end(), values.begin(),
+         [](long a, long b) { return a + b; });
+      for (size_t i = 0; i < count; i++) {
+         const long expected = static_cast<long>((i + 1) * (i + 2) / 2);
+         check(values[i] == expected, __func__, "in-place prefix " + std::to_string(i) + " of "
+            + std::to_string(count) + " is " + std::to_string(values[i]));
+      }
+   }
+   passed(__func__);
+}
+
+/* a task calling the algorithms without a pool forks onto the pool running it */
+void inside_task(ThreadPool &pool) {
+   Scheduler graph{pool};
+   const size_t count = 10007;
+   std::vector<long> values(count);
+   long total = 0;
+   auto fill = graph.silent_add([&values]() {
+      parallel_for(static_cast<ThreadPool*>(nullptr), size_t{0}, values.size(),
+         [&values](size_t i) { values[i] = static_cast<long>(i); });
+   });
+   auto sum = graph.silent_add([&]() {
+      parallel_scan(static_cast<ThreadPool*>(nullptr), values.begin(), values.end(),
+         values.begin(), [](long a, long b) { return a + b; });
+      total = parallel_reduce(static_cast<ThreadPool*>(nullptr), values.begin(),
+         values.end(), 0L, [](long a, long b) { return a + b; });
+   });
+   graph.direct(fill, sum);
+   graph.run_n(2);
+   graph.wait();
+   long expected = 0;
+   for (size_t i = 0; i < count; i++) {
+      expected += static_cast<long>(i * (i + 1) / 2);
+   }
+   check(total == expected, __func__, "the task's reduce gave " + std::to_string(total));
+   passed(__func__);
+}
+
+/* the caller's own share throwing leaves the forked jobs to finish before the
+algorithm's state goes away */
+void caller_throws(ThreadPool &pool) {
+   for (int attempt = 0; attempt < 20; attempt++) {
+      std::atomic<int> visited{0};
+      bool thrown = false;
+      try {
+         parallel_for(pool, 0, 4096, [&visited](int i) {
+            visited++;
+            if (i == 0) {
+               throw std::runtime_error{"first"};
+            }
+         }, 1);
+      } catch (const std::runtime_error&) {
+         thrown = true;
+      }
+      check(thrown, __func__, "the exception should reach the caller");
+   }
+   passed(__func__);
+}
+
+int main() {
+   for (const int threads : {1, 2, 3, 4}) {
+      ThreadPool pool{threads};
+      std::cout << "pool of " << threads << '\n';
+      for_each_index(pool);
+      transform(pool);
+      reduce(pool);
+      scan(pool);
+      inside_task(pool);
+      caller_throws(pool);
+   }
+   return 0;
+}
+
+}
+
+int main() {
+   return Test::main();
+}
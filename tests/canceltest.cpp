@@ -0,0 +1,170 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <stdexcept>
+#include <cstdlib>
+
+#include "../src/Parallel/Scheduler.hpp"
+
+/* checks that exceptions thrown by tasks and jobs reach their callers, and that
+cancelled runs skip what is left of the graph. exits with 1 on the first failed 
+check */
+
+using namespace Parallel;
+
+namespace Test {
+
+void check(const bool passed, const char *caller, const std::string &what) {
+   if (!passed) {
+      std::cerr << "ERROR - " << caller << "()\n";
+      std::cerr << "-----------------------------\n";
+      std::cerr << what << '\n';
+      std::exit(1);
+   }
+}
+
+void passed(const char *caller) {
+   std::cout << caller << "() PASSED\n";
+}
+
+/* wait() rethrows the first exception, and the next run neither sees it again nor
+skips anything */
+void rethrow_and_rerun(ThreadPool &pool) {
+   Scheduler graph{pool};
+   bool fail = true;
+   std::atomic<int> after{0};
+   auto thrower = graph.silent_add([&fail]() {
+      if (fail) {
+         throw std::runtime_error{"first run"};
+      }
+   });
+   auto next = graph.silent_add([&after]() { after++; });
+   graph.direct(thrower, next);
+   graph.execute();
+   bool thrown = false;
+   try {
+      graph.wait();
+   } catch (const std::runtime_error &error) {
+      thrown = std::string{error.what()} == "first run";
+   }
+   check(thrown, __func__, "wait() should rethrow the task's exception");
+   check(after == 0, __func__, "the failed task's successor should be skipped");
+   fail = false;
+   graph.execute();
+   graph.wait();
+   check(after == 1, __func__, "the next run should run every task");
+   passed(__func__);
+}
+
+/* a Result whose producer was skipped holds a cancelled_error */
+void cancelled_result(ThreadPool &pool) {
+   Scheduler graph{pool};
+   auto thrower = graph.silent_add([]() { throw std::runtime_error{"upstream"}; });
+   auto [producer, value] = graph.add([]() { return 42; });
+   graph.direct(thrower, producer);
+   graph.execute();
+   try {
+      graph.wait();
+   } catch (const std::runtime_error&) {}
+   bool cancelled = false;
+   try {
+      value.get();
+   } catch (const cancelled_error&) {
+      cancelled = true;
+   }
+   check(cancelled, __func__, "get() should throw cancelled_error");
+   passed(__func__);
+}
+
+/* the future of a throwing task holds its exception */
+void future_exception(ThreadPool &pool) {
+   Scheduler graph{pool};
+   auto [task, future] = graph.add_future([]() -> int { throw std::out_of_range{"future"}; });
+   graph.execute();
+   try {
+      graph.wait();
+   } catch (const std::out_of_range&) {}
+   bool thrown = false;
+   try {
+      future.get();
+   } catch (const std::out_of_range &error) {
+      thrown = std::string{error.what()} == "future";
+   }
+   check(thrown, __func__, "the future should hold the task's exception");
+   passed(__func__);
+}
+
+/* a task cancelling through a token stops the chain behind it */
+void token_cancel(ThreadPool &pool) {
+   Scheduler graph{pool};
+   CancellationToken token = graph.token();
+   std::atomic<int> ran{0};
+   std::vector<Task> chain;
+   for (int i = 0; i < 10; i++) {
+      chain.push_back(graph.silent_add([&ran, token, i]() {
+         ran++;
+         if (i == 3) {
+            token.cancel();
+         }
+      }));
+   }
+   for (size_t i = 1; i < chain.size(); i++) {
+      graph.direct(chain[i - 1], chain[i]);
+   }
+   graph.execute();
+   graph.wait();
+   check(ran == 4, __func__, "expected 4 tasks to run, " + std::to_string(ran.load()) + " ran");
+   check(token.cancelled(), __func__, "the token should report the cancellation");
+   ran = 0;
+   graph.execute();
+   graph.wait();
+   check(ran == 4, __func__, "a new run should start uncancelled, " + std::to_string(ran.load()) 
+      + " tasks ran");
+   passed(__func__);
+}
+
+/* an exception thrown by a job is rethrown by join(), and by the algorithms 
+built on it */
+void job_exception(ThreadPool &pool) {
+   bool thrown = false;
+   try {
+      parallel_for(pool, 0, 10000, [](int i) {
+         if (i == 5000) {
+            throw std::runtime_error{"body"};
+         }
+      }, 16);
+   } catch (const std::runtime_error &error) {
+      thrown = std::string{error.what()} == "body";
+   }
+   check(thrown, __func__, "parallel_for should rethrow the body's exception");
+   thrown = false;
+   JobGroup group{&pool};
+   group.fork([]() {});
+   group.fork([]() { throw std::logic_error{"job"}; });
+   try {
+      group.join();
+   } catch (const std::logic_error &error) {
+      thrown = std::string{error.what()} == "job";
+   }
+   check(thrown, __func__, "join() should rethrow the job's exception");
+   group.fork([]() {});
+   group.join();
+   passed(__func__);
+}
+
+int main() {
+   ThreadPool pool{4};
+   rethrow_and_rerun(pool);
+   cancelled_result(pool);
+   future_exception(pool);
+   token_cancel(pool);
+   job_exception(pool);
+   return 0;
+}
+
+}
+
+int main() {
+   return Test::main();
+}
@@ -0,0 +1,195 @@
+#include <iostream>
+#include <string>
+#include <atomic>
+#include <stdexcept>
+#include <cstdlib>
+
+#include "../src/Parallel/Scheduler.hpp"
+
+/* checks condition tasks: loops and branches within a run, across repeated runs,
+and when the run fails or is cancelled. exits with 1 on the first failed check */
+
+using namespace Parallel;
+
+namespace Test {
+
+void check(const bool passed, const char *caller, const std::string &what) {
+   if (!passed) {
+      std::cerr << "ERROR - " << caller << "()\n";
+      std::cerr << "-----------------------------\n";
+      std::cerr << what << '\n';
+      std::exit(1);
+   }
+}
+
+void passed(const char *caller) {
+   std::cout << caller << "() PASSED\n";
+}
+
+/* init -> body -> cond, which leads back to body until it has run ten times in the
+run, then on to done. each of the repeats of run_n loops afresh */
+void loop_run_n(ThreadPool &pool) {
+   Scheduler graph{pool};
+   int count = 0;
+   int body_runs = 0;
+   int done_runs = 0;
+   auto init = graph.silent_add([&count]() { count = 0; });
+   auto body = graph.silent_add([&]() {
+      count++;
+      body_runs++;
+   });
+   auto cond = graph.condition([&count]() { return (count < 10) ? 0 : 1; });
+   auto done = graph.silent_add([&done_runs]() { done_runs++; });
+   graph.direct(init, body);
+   graph.direct(body, cond);
+   graph.direct(cond, body, done);
+   graph.run_n(3);
+   graph.wait();
+   check(body_runs == 30, __func__, "the body should run 30 times, ran "
+      + std::to_string(body_runs));
+   check(done_runs == 3, __func__, "the exit should run once per repeat, ran "
+      + std::to_string(done_runs));
+   passed(__func__);
+}
+
+/* source -> side and source -> cond, cond picks left or right, and join waits on
+side and left. the branch alternates across the repeats, so join fires on those
+that take left and the one not taken never runs */
+void branch_join(ThreadPool &pool) {
+   Scheduler graph{pool};
+   int pick = 0;
+   int left_runs = 0;
+   int right_runs = 0;
+   std::atomic<int> join_runs{0};
+   auto source = graph.silent_add([]() {});
+   auto side = graph.silent_add([]() {});
+   auto cond = graph.condition([&pick]() { return pick++ % 2; });
+   auto left = graph.silent_add([&left_runs]() { left_runs++; });
+   auto right = graph.silent_add([&right_runs]() { right_runs++; });
+   auto join = graph.silent_add([&join_runs]() { join_runs++; });
+   graph.direct(source, side, cond);
+   graph.direct(cond, left, right);
+   graph.direct(side, join);
+   graph.direct(left, join);
+   graph.run_n(4);
+   graph.wait();
+   check(left_runs == 2 && right_runs == 2, __func__, "expected 2 runs of each branch, got "
+      + std::to_string(left_runs) + " and " + std::to_string(right_runs));
+   check(join_runs == 2, __func__, "the join should fire with every left branch, fired "
+      + std::to_string(join_runs.load()));
+   pick = 0;
+   graph.run_n(4);
+   graph.wait();
+   check(join_runs == 4, __func__, "the join should fire again on the next repeats, fired "
+      + std::to_string(join_runs.load()));
+   passed(__func__);
+}
+
+/* a condition that throws picks nothing, so the loop ends and wait() rethrows */
+void throwing_condition(ThreadPool &pool) {
+   Scheduler graph{pool};
+   int count = 0;
+   bool after = false;
+   auto init = graph.silent_add([&count]() { count = 0; });
+   auto body = graph.silent_add([&count]() { count++; });
+   auto cond = graph.condition([&count]() {
+      if (count == 5) {
+         throw std::runtime_error{"condition"};
+      }
+      return 0;
+   });
+   auto exit = graph.silent_add([&after]() { after = true; });
+   graph.direct(init, body);
+   graph.direct(body, cond);
+   graph.direct(cond, body, exit);
+   graph.execute();
+   bool thrown = false;
+   try {
+      graph.wait();
+   } catch (const std::runtime_error &error) {
+      thrown = std::string{error.what()} == "condition";
+   }
+   check(thrown, __func__, "wait() should rethrow the condition's exception");
+   check(count == 5 && !after, __func__, "the loop should stop at the throw, body ran "
+      + std::to_string(count) + " times");
+   passed(__func__);
+}
+
+/* cancelling from the body ends a loop that would otherwise never exit */
+void cancelled_loop(ThreadPool &pool) {
+   Scheduler graph{pool};
+   CancellationToken token = graph.token();
+   int count = 0;
+   auto init = graph.silent_add([&count]() { count = 0; });
+   auto body = graph.silent_add([&count, token]() {
+      if (++count == 20) {
+         token.cancel();
+      }
+   });
+   auto cond = graph.condition([]() { return 0; });
+   graph.direct(init, body);
+   graph.direct(body, cond);
+   graph.direct(cond, body);
+   graph.execute();
+   graph.wait();
+   check(count == 20, __func__, "the body should stop at the cancel, ran "
+      + std::to_string(count) + " times");
+   graph.execute();
+   graph.wait();
+   check(count == 20, __func__, "a new run should loop until it cancels again, ran "
+      + std::to_string(count) + " times");
+   passed(__func__);
+}
+
+/* compile() rejects a cycle of ordinary edges, but a condition may lead back */
+void back_edges(ThreadPool &pool) {
+   {
+      Scheduler graph{pool};
+      auto a = graph.silent_add([]() {});
+      auto b = graph.silent_add([]() {});
+      graph.direct(a, b);
+      graph.direct(b, a);
+      bool thrown = false;
+      try {
+         graph.compile();
+      } catch (const cycle_error&) {
+         thrown = true;
+      }
+      check(thrown, __func__, "a strong cycle should throw cycle_error");
+   }
+   Scheduler graph{pool};
+   int count = 0;
+   auto init = graph.silent_add([&count]() { count = 0; });
+   auto a = graph.silent_add([&count]() { count++; });
+   auto cond = graph.condition([&count]() { return (count < 3) ? 0 : 1; });
+   graph.direct(init, a);
+   graph.direct(a, cond);
+   graph.direct(cond, a);
+   bool thrown = false;
+   try {
+      graph.compile();
+   } catch (const cycle_error&) {
+      thrown = true;
+   }
+   check(!thrown, __func__, "a weak back edge should compile");
+   graph.execute();
+   graph.wait();
+   check(count == 3, __func__, "the loop should run 3 times, ran " + std::to_string(count));
+   passed(__func__);
+}
+
+int main() {
+   ThreadPool pool{4};
+   loop_run_n(pool);
+   branch_join(pool);
+   throwing_condition(pool);
+   cancelled_loop(pool);
+   back_edges(pool);
+   return 0;
+}
+
+}
+
+int main() {
+   return Test::main();
+}
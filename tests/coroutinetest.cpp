@@ -0,0 +1,162 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <stdexcept>
+#include <cstdlib>
+
+#include "../src/Parallel/Scheduler.hpp"
+
+/* checks coroutine tasks awaiting results, events, timers and other coroutines
+without holding their workers, over repeated runs. exits with 1 on the first
+failed check */
+
+using namespace Parallel;
+using namespace std::chrono_literals;
+
+namespace Test {
+
+void check(const bool passed, const char *caller, const std::string &what) {
+   if (!passed) {
+      std::cerr << "ERROR - " << caller << "()\n";
+      std::cerr << "-----------------------------\n";
+      std::cerr << what << '\n';
+      std::exit(1);
+   }
+}
+
+void passed(const char *caller) {
+   std::cout << caller << "() PASSED\n";
+}
+
+/* the consumer starts once the producer's run has begun and awaits its Result
+without an edge, so it must wait for this run's value rather than see the last
+run's, which the producer's start clears */
+void result_each_run(ThreadPool &pool) {
+   Scheduler graph{pool};
+   std::atomic<int> run{0};
+   std::atomic<bool> producing{false};
+   std::vector<int> seen;
+   auto [produce, produced] = graph.add([&]() {
+      const int value = ++run;
+      producing = true;
+      std::this_thread::sleep_for(10ms);
+      return value;
+   });
+   auto gate = graph.silent_add([&producing]() {
+      while (!producing) {
+         std::this_thread::yield();
+      }
+   });
+   auto consume = graph.silent_add([&, result = produced]() -> Coroutine<> {
+      seen.push_back(co_await result);
+      producing = false;
+   });
+   graph.direct(gate, consume);
+   graph.run_n(5);
+   graph.wait();
+   bool current = seen.size() == 5;
+   for (size_t i = 0; current && i < seen.size(); i++) {
+      current = seen[i] == static_cast<int>(i + 1);
+   }
+   check(current, __func__, "each run's coroutine should await that run's value");
+   passed(__func__);
+}
+
+/* an event set from another thread resumes the coroutines parked on it, and a
+reset one parks them again on the next run */
+void event(ThreadPool &pool) {
+   Scheduler graph{pool};
+   Event ready;
+   std::atomic<int> resumed{0};
+   for (int i = 0; i < 8; i++) {
+      graph.silent_add([&]() -> Coroutine<> {
+         co_await ready;
+         resumed++;
+      });
+   }
+   for (int run = 1; run <= 2; run++) {
+      graph.execute();
+      std::this_thread::sleep_for(20ms);
+      check(resumed == 8 * (run - 1), __func__, "coroutines resumed before the event was set");
+      ready.set();
+      graph.wait();
+      check(resumed == 8 * run, __func__, std::to_string(resumed.load())
+         + " coroutines resumed after the event, expected " + std::to_string(8 * run));
+      ready.reset();
+   }
+   passed(__func__);
+}
+
+/* many sleepers on two workers overlap, each sleeping at least its delay */
+void timers(ThreadPool &pool) {
+   Scheduler graph{pool};
+   std::atomic<int> woke{0};
+   std::atomic<bool> early{false};
+   for (int i = 0; i < 200; i++) {
+      graph.silent_add([&]() -> Coroutine<> {
+         const auto start = std::chrono::steady_clock::now();
+         co_await after(20ms);
+         if (std::chrono::steady_clock::now() - start < 20ms) {
+            early = true;
+         }
+         woke++;
+      });
+   }
+   const auto start = std::chrono::steady_clock::now();
+   graph.execute();
+   graph.wait();
+   const auto elapsed = std::chrono::steady_clock::now() - start;
+   check(woke == 200 && !early, __func__, "every sleeper should wake after its delay");
+   check(elapsed < 2s, __func__, "200 sleepers of 20 ms took "
+      + std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count())
+      + " ms, they should overlap");
+   passed(__func__);
+}
+
+Coroutine<int> twice(const int value) {
+   co_await after(1ms);
+   co_return 2 * value;
+}
+
+Coroutine<int> fails() {
+   co_await after(1ms);
+   throw std::out_of_range{"inner"};
+}
+
+/* a coroutine awaiting another gets its value, or its exception */
+void nested(ThreadPool &pool) {
+   Scheduler graph{pool};
+   bool caught = false;
+   auto [task, result] = graph.add([&caught]() -> Coroutine<int> {
+      int value = co_await twice(co_await twice(5));
+      try {
+         value += co_await fails();
+      } catch (const std::out_of_range&) {
+         caught = true;
+      }
+      co_return value;
+   });
+   graph.execute();
+   graph.wait();
+   check(result.get() == 20 && caught, __func__, "the coroutine gave "
+      + std::to_string(result.get()));
+   passed(__func__);
+}
+
+int main() {
+   ThreadPool pool{2};
+   result_each_run(pool);
+   event(pool);
+   timers(pool);
+   nested(pool);
+   return 0;
+}
+
+}
+
+int main() {
+   return Test::main();
+}
@@ -0,0 +1,232 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <system_error>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../src/Parallel/Scheduler.hpp"
+
+/* checks the asynchronous I/O tasks on local files and pipes, once through an
+io_uring ring where the kernel offers one and once through blocking threads.
+exits with 1 on the first failed check */
+
+using namespace Parallel;
+
+namespace Test {
+
+void check(const bool passed, const char *caller, const std::string &what) {
+   if (!passed) {
+      std::cerr << "ERROR - " << caller << "()\n";
+      std::cerr << "-----------------------------\n";
+      std::cerr << what << '\n';
+      std::exit(1);
+   }
+}
+
+void passed(const char *caller, const IoService &service) {
+   std::cout << caller << "() PASSED"
+      << ((service.backend() == IoService::Backend::uring) ? " (io_uring)\n" : " (threads)\n");
+}
+
+/* an empty file that is removed once closed */
+int temp_file() {
+   char path[] = "/tmp/iotestXXXXXX";
+   const int fd = mkstemp(path);
+   check(fd >= 0, __func__, "mkstemp failed");
+   unlink(path);
+   return fd;
+}
+
+std::string pattern(const size_t size, const char seed) {
+   std::string text(size, '\0');
+   for (size_t i = 0; i < size; i++) {
+      text[i] = static_cast<char>(seed + i % 23);
+   }
+   return text;
+}
+
+/* writes at offsets, syncs and reads back through graph tasks ordered by edges */
+void file_round_trip(ThreadPool &pool) {
+   const int fd = temp_file();
+   const std::string first = pattern(4096, 'a');
+   const std::string second = pattern(1000, 'A');
+   std::string back(first.size() + second.size(), '\0');
+   Scheduler graph{pool};
+   auto [write_first, wrote_first] = graph.write(fd, first.data(), first.size(), 0);
+   auto [write_second, wrote_second] = graph.write(fd, second.data(), second.size(),
+      first.size());
+   auto sync = graph.fsync(fd);
+   auto [read_back, got] = graph.read(fd, back.data(), back.size(), 0);
+   graph.direct(write_first, sync);
+   graph.direct(write_second, sync);
+   graph.direct(sync, read_back);
+   graph.execute();
+   graph.wait();
+   check(wrote_first.get() == first.size() && wrote_second.get() == second.size(), __func__,
+      "short write");
+   check(got.get() == back.size(), __func__, "short read");
+   check(back == first + second, __func__, "read back different bytes");
+   close(fd);
+   passed(__func__, pool.io());
+}
+
+/* a reader waits on an empty pipe while the only worker runs the writer, which a
+blocking read would deadlock */
+void pipe_single_worker(IoService &service) {
+   ThreadPool pool{1};
+   int ends[2];
+   check(pipe(ends) == 0, __func__, "pipe failed");
+   const std::string message = pattern(3000, '0');
+   std::string received;
+   Scheduler graph{pool};
+   auto reader = graph.silent_add([&]() -> Coroutine<> {
+      char chunk[512];
+      while (received.size() < message.size()) {
+         const size_t count = co_await service.read(ends[0], chunk, sizeof(chunk));
+         if (count == 0) {
+            break;
+         }
+         received.append(chunk, count);
+      }
+   });
+   graph.silent_add([&]() -> Coroutine<> {
+      size_t sent = 0;
+      while (sent < message.size()) {
+         const size_t count = std::min<size_t>(700, message.size() - sent);
+         sent += co_await service.write(ends[1], message.data() + sent, count);
+      }
+   });
+   // the reader is the more urgent source, so it starts first and parks
+   reader.cost(10);
+   graph.prioritize(PriorityPolicy::estimates);
+   graph.execute();
+   graph.wait();
+   check(received == message, __func__, "pipe delivered " + std::to_string(received.size())
+      + " of " + std::to_string(message.size()) + " bytes");
+   close(ends[0]);
+   close(ends[1]);
+   passed(__func__, service);
+}
+
+/* more readers parked on empty pipes than the threads backend starts with, all
+submitted before any writer, so the writers' calls must not queue behind them */
+void many_pipes(IoService &service) {
+   ThreadPool pool{1};
+   const size_t num_pipes = 6;
+   const std::string message = pattern(1500, 'k');
+   std::vector<std::array<int, 2>> ends(num_pipes);
+   std::vector<std::string> received(num_pipes);
+   Scheduler graph{pool};
+   for (size_t i = 0; i < num_pipes; i++) {
+      check(pipe(ends[i].data()) == 0, __func__, "pipe failed");
+      auto reader = graph.silent_add([&, i]() -> Coroutine<> {
+         char chunk[512];
+         while (received[i].size() < message.size()) {
+            const size_t count = co_await service.read(ends[i][0], chunk, sizeof(chunk));
+            if (count == 0) {
+               break;
+            }
+            received[i].append(chunk, count);
+         }
+      });
+      reader.cost(10);
+      graph.silent_add([&, i]() -> Coroutine<> {
+         size_t sent = 0;
+         while (sent < message.size()) {
+            sent += co_await service.write(ends[i][1], message.data() + sent,
+               message.size() - sent);
+         }
+      });
+   }
+   graph.prioritize(PriorityPolicy::estimates);
+   graph.execute();
+   graph.wait();
+   for (size_t i = 0; i < num_pipes; i++) {
+      check(received[i] == message, __func__, "pipe " + std::to_string(i) + " delivered "
+         + std::to_string(received[i].size()) + " of " + std::to_string(message.size())
+         + " bytes");
+      close(ends[i][0]);
+      close(ends[i][1]);
+   }
+   passed(__func__, service);
+}
+
+/* far more requests than the ring holds at once, each reading its own block */
+void many_requests(IoService &service, ThreadPool &pool) {
+   const int fd = temp_file();
+   const size_t blocks = 2000;
+   const size_t block = 64;
+   const std::string data = pattern(blocks * block, '!');
+   check(pwrite(fd, data.data(), data.size(), 0) == static_cast<ssize_t>(data.size()),
+      __func__, "setup write failed");
+   std::vector<char> back(data.size(), '\0');
+   std::atomic<size_t> total{0};
+   Scheduler graph{pool};
+   for (size_t i = 0; i < blocks; i++) {
+      graph.silent_add([&, i]() -> Coroutine<> {
+         total += co_await service.read(fd, back.data() + i * block, block, i * block);
+      });
+   }
+   graph.execute();
+   graph.wait();
+   check(total == data.size(), __func__, "read " + std::to_string(total.load()) + " bytes");
+   check(std::memcmp(back.data(), data.data(), data.size()) == 0, __func__,
+      "blocks read back different bytes");
+   close(fd);
+   passed(__func__, service);
+}
+
+/* a failed call reaches the result as a std::system_error */
+void bad_descriptor(IoService &service, ThreadPool &pool) {
+   Scheduler graph{pool};
+   char buffer[16];
+   auto [task, result] = graph.add([&]() -> Coroutine<size_t> {
+      co_return co_await service.read(-1, buffer, sizeof(buffer));
+   });
+   graph.execute();
+   bool thrown = false;
+   try {
+      graph.wait();
+   } catch (const std::system_error &error) {
+      thrown = error.code().value() == EBADF;
+   }
+   check(thrown, __func__, "wait() should rethrow EBADF");
+   thrown = false;
+   try {
+      result.get();
+   } catch (const std::system_error &error) {
+      thrown = error.code().value() == EBADF;
+   }
+   check(thrown, __func__, "the result should hold EBADF");
+   passed(__func__, service);
+}
+
+int main() {
+   ThreadPool pool{2};
+   IoService ring{8, IoService::Backend::uring};
+   IoService threads{8, IoService::Backend::threads};
+   if (ring.backend() != IoService::Backend::uring) {
+      std::cout << "io_uring unavailable, both runs use threads\n";
+   }
+   file_round_trip(pool);
+   for (IoService *service : {&ring, &threads}) {
+      pipe_single_worker(*service);
+      many_pipes(*service);
+      many_requests(*service, pool);
+      bad_descriptor(*service, pool);
+   }
+   return 0;
+}
+
+}
+
+int main() {
+   return Test::main();
+}
@@ -0,0 +1,190 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <stdexcept>
+#include <cstdlib>
+
+#include "../src/Parallel/Scheduler.hpp"
+
+/* checks module tasks, which run another graph in place within a run: ordering
+around them, failure and cancellation crossing between the two graphs, and reuse
+of one graph by several modules. exits with 1 on the first failed check */
+
+using namespace Parallel;
+
+namespace Test {
+
+void check(const bool passed, const char *caller, const std::string &what) {
+   if (!passed) {
+      std::cerr << "ERROR - " << caller << "()\n";
+      std::cerr << "-----------------------------\n";
+      std::cerr << what << '\n';
+      std::exit(1);
+   }
+}
+
+void passed(const char *caller) {
+   std::cout << caller << "() PASSED\n";
+}
+
+/* a chain of count tasks, each adding one to ran */
+std::vector<Task> chain(Scheduler &graph, std::atomic<int> &ran, const int count) {
+   std::vector<Task> tasks;
+   for (int i = 0; i < count; i++) {
+      tasks.push_back(graph.silent_add([&ran]() { ran++; }));
+   }
+   for (size_t i = 1; i < tasks.size(); i++) {
+      graph.direct(tasks[i - 1], tasks[i]);
+   }
+   return tasks;
+}
+
+/* the module's successor sees every task of the inner graph done */
+void before_successors(ThreadPool &pool) {
+   Scheduler inner{pool};
+   std::atomic<int> ran{0};
+   chain(inner, ran, 20);
+   Scheduler outer{pool};
+   int seen = -1;
+   auto module = outer.module(inner);
+   auto after = outer.silent_add([&]() { seen = ran.load(); });
+   outer.direct(module, after);
+   for (int run = 1; run <= 3; run++) {
+      outer.execute();
+      outer.wait();
+      check(seen == 20 * run, __func__, "the successor ran after " + std::to_string(seen)
+         + " inner tasks, expected " + std::to_string(20 * run));
+   }
+   passed(__func__);
+}
+
+/* an inner task's exception fails the module, so the outer run rethrows it and
+skips what follows the module */
+void inner_exception(ThreadPool &pool) {
+   Scheduler inner{pool};
+   inner.silent_add([]() { throw std::runtime_error{"inner"}; });
+   Scheduler outer{pool};
+   bool after = false;
+   auto module = outer.module(inner);
+   auto next = outer.silent_add([&after]() { after = true; });
+   outer.direct(module, next);
+   outer.execute();
+   bool thrown = false;
+   try {
+      outer.wait();
+   } catch (const std::runtime_error &error) {
+      thrown = std::string{error.what()} == "inner";
+   }
+   check(thrown, __func__, "the outer run should rethrow the inner exception");
+   check(!after, __func__, "the module's successor should be skipped");
+   passed(__func__);
+}
+
+/* cancelling the outer run from inside the module skips the rest of both graphs */
+void outer_cancel(ThreadPool &pool) {
+   Scheduler outer{pool};
+   CancellationToken token = outer.token();
+   Scheduler inner{pool};
+   std::atomic<int> ran{0};
+   auto tasks = chain(inner, ran, 10);
+   auto canceller = inner.silent_add([token]() { token.cancel(); });
+   inner.direct(tasks[2], canceller);
+   inner.direct(canceller, tasks[3]);
+   bool after = false;
+   auto module = outer.module(inner);
+   auto next = outer.silent_add([&after]() { after = true; });
+   outer.direct(module, next);
+   outer.execute();
+   outer.wait();
+   check(ran == 3, __func__, "the inner graph should stop at the cancel, "
+      + std::to_string(ran.load()) + " tasks ran");
+   check(!after, __func__, "the module's successor should be skipped");
+   ran = 0;
+   inner.execute();
+   inner.wait();
+   check(ran == 10, __func__, "the inner graph run alone should not see the outer cancel");
+   passed(__func__);
+}
+
+/* one graph as two modules: in sequence it runs twice, and side by side either
+the runs happen not to overlap or the later one fails as already running. the
+graphs run normally afterwards */
+void reused_module(ThreadPool &pool) {
+   Scheduler inner{pool};
+   std::atomic<int> ran{0};
+   chain(inner, ran, 5);
+   {
+      Scheduler outer{pool};
+      auto first = outer.module(inner);
+      auto second = outer.module(inner);
+      outer.direct(first, second);
+      outer.execute();
+      outer.wait();
+      check(ran == 10, __func__, "two modules in sequence should run the graph twice, "
+         + std::to_string(ran.load()) + " tasks ran");
+   }
+   for (int attempt = 0; attempt < 20; attempt++) {
+      ran = 0;
+      Scheduler outer{pool};
+      outer.module(inner);
+      outer.module(inner);
+      outer.execute();
+      bool rejected = false;
+      try {
+         outer.wait();
+      } catch (const std::logic_error&) {
+         rejected = true;
+      }
+      check(rejected ? ran == 5 : ran == 10, __func__, std::to_string(ran.load())
+         + " tasks ran for modules side by side");
+   }
+   ran = 0;
+   inner.execute();
+   inner.wait();
+   check(ran == 5, __func__, "the graph should run again after the modules");
+   passed(__func__);
+}
+
+/* a module of a graph that is running on its own fails without touching that run */
+void running_graph(ThreadPool &pool) {
+   Scheduler inner{pool};
+   std::atomic<bool> release{false};
+   std::atomic<int> ran{0};
+   auto gate = inner.silent_add([&release]() { release.wait(false); });
+   auto tasks = chain(inner, ran, 3);
+   inner.direct(gate, tasks[0]);
+   inner.execute();
+   Scheduler outer{pool};
+   outer.module(inner);
+   outer.execute();
+   bool rejected = false;
+   try {
+      outer.wait();
+   } catch (const std::logic_error&) {
+      rejected = true;
+   }
+   check(rejected, __func__, "a module of a running graph should throw std::logic_error");
+   release = true;
+   release.notify_all();
+   inner.wait();
+   check(ran == 3, __func__, "the graph's own run should finish, " + std::to_string(ran.load())
+      + " tasks ran");
+   passed(__func__);
+}
+
+int main() {
+   ThreadPool pool{4};
+   before_successors(pool);
+   inner_exception(pool);
+   outer_cancel(pool);
+   reused_module(pool);
+   running_graph(pool);
+   return 0;
+}
+
+}
+
+int main() {
+   return Test::main();
+}
@@ -0,0 +1,143 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#include "../src/Parallel/Scheduler.hpp"
+
+/* checks the ranks PriorityPolicy gives a graph's tasks and the order its sources
+start in. exits with 1 on the first failed check */
+
+using namespace Parallel;
+
+namespace Test {
+
+void check(const bool passed, const char *caller, const std::string &what) {
+   if (!passed) {
+      std::cerr << "ERROR - " << caller << "()\n";
+      std::cerr << "-----------------------------\n";
+      std::cerr << what << '\n';
+      std::exit(1);
+   }
+}
+
+void passed(const char *caller) {
+   std::cout << caller << "() PASSED\n";
+}
+
+std::string levels(const std::vector<const Task*> &tasks) {
+   std::string text;
+   for (const Task *task : tasks) {
+      text += task->name() + "=" + std::to_string(task->priority()) + " ";
+   }
+   return text;
+}
+
+/* a chain of four and a lone task. bottom levels 4, 3, 2, 1 and 1 out of a longest
+of 4 split into the bands 0, 1, 2, 3 and 3 */
+void hops() {
+   ThreadPool pool{1};
+   Scheduler graph{pool};
+   auto lone = graph.silent_add([]() {});
+   auto a = graph.silent_add([]() {});
+   auto b = graph.silent_add([]() {});
+   auto c = graph.silent_add([]() {});
+   auto d = graph.silent_add([]() {});
+   lone.name("lone"); a.name("a"); b.name("b"); c.name("c"); d.name("d");
+   graph.linearize(a, b, c, d);
+   graph.prioritize(PriorityPolicy::hops);
+   graph.execute();
+   graph.wait();
+   const std::string found = levels({&a, &b, &c, &d, &lone});
+   check(a.priority() == 0 && b.priority() == 1 && c.priority() == 2 && d.priority() == 3
+      && lone.priority() == 3, __func__, "expected a=0 b=1 c=2 d=3 lone=3, got " + found);
+   passed(__func__);
+}
+
+/* costs outweigh hop counts: the expensive head of a short chain ranks above a
+cheaper task that hops rank the same as its successor */
+void estimates() {
+   ThreadPool pool{1};
+   Scheduler graph{pool};
+   auto heavy = graph.silent_add([]() {});
+   auto light = graph.silent_add([]() {});
+   auto middle = graph.silent_add([]() {});
+   heavy.name("heavy").cost(100);
+   light.name("light").cost(1);
+   middle.name("middle").cost(10);
+   graph.direct(heavy, light);
+   graph.prioritize(PriorityPolicy::hops);
+   graph.execute();
+   graph.wait();
+   std::string found = levels({&heavy, &light, &middle});
+   check(heavy.priority() == 1 && light.priority() == 2 && middle.priority() == 2, __func__, 
+      "hops: expected heavy=1 light=2 middle=2, got " + found);
+   graph.prioritize(PriorityPolicy::estimates);
+   graph.execute();
+   graph.wait();
+   found = levels({&heavy, &light, &middle});
+   check(heavy.priority() == 0 && light.priority() == 3 && middle.priority() == 3, __func__,
+      "estimates: expected heavy=0 light=3 middle=3, got " + found);
+   passed(__func__);
+}
+
+/* a single worker takes the sources in the order they were queued, so the order
+they start in is the order the ranking left them in */
+void source_order() {
+   ThreadPool pool{1};
+   Scheduler graph{pool};
+   std::vector<std::string> started;
+   auto record = [&started](const char *label) {
+      return [&started, label]() { started.push_back(label); };
+   };
+   graph.silent_add(record("lone"));
+   auto head = graph.silent_add(record("head"));
+   auto tail = graph.silent_add(record("tail"));
+   graph.direct(head, tail);
+   graph.execute();
+   graph.wait();
+   check(started.front() == "lone", __func__, "unranked sources should start as declared");
+   started.clear();
+   graph.prioritize(PriorityPolicy::hops);
+   graph.execute();
+   graph.wait();
+   check(started.size() == 3 && started[0] == "head", __func__, 
+      "the source heading the longer chain should start first, started " + started[0]);
+   passed(__func__);
+}
+
+/* none resets every rank a previous policy gave */
+void none() {
+   ThreadPool pool{1};
+   Scheduler graph{pool};
+   auto a = graph.silent_add([]() {});
+   auto b = graph.silent_add([]() {});
+   auto c = graph.silent_add([]() {});
+   a.name("a"); b.name("b"); c.name("c");
+   graph.linearize(a, b, c);
+   graph.prioritize(PriorityPolicy::hops);
+   graph.execute();
+   graph.wait();
+   check(a.priority() != c.priority(), __func__, "hops should rank the chain unequally");
+   graph.prioritize(PriorityPolicy::none);
+   graph.execute();
+   graph.wait();
+   const std::string found = levels({&a, &b, &c});
+   check(a.priority() == 0 && b.priority() == 0 && c.priority() == 0, __func__, 
+      "expected every task at 0, got " + found);
+   passed(__func__);
+}
+
+int main() {
+   hops();
+   estimates();
+   source_order();
+   none();
+   return 0;
+}
+
+}
+
+int main() {
+   return Test::main();
+}
@@ -1,328 +1,336 @@
 #include <iostream>
 #include <thread>
 #include <string>
-#include <initializer_list>
-#include <condition_variable>
-#include <mutex>
-#include <cmath>
-#include <windows.h>
+#include <vector>
 #include <atomic>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
 
 #include "../src/Parallel/WorkStealingQueue.hpp"
 
+/* checks and measures the work-stealing deque. with no arguments runs the
+single-threaded checks, a short stress run and a short benchmark; otherwise
+   queuetest stress [thieves] [items] [rounds]
+   queuetest bench [thieves] [items]
+exits with 1 on the first failed check */
+
 using namespace Parallel;
 
 namespace Test {
 
-using Comparator = std::initializer_list<std::string>;
-
-static constexpr int max_bufsize = Parallel::bs;
-
-HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
-std::condition_variable cv;
-std::mutex mu;
-std::atomic<bool> flag = false;
-std::array<std::atomic<int>, 7> counter;
-
-struct Worker {
-   
-   int own_id;
-   std::thread worker;
-   WorkStealingQueue jobs;
-   Worker *sibling;
-
-   Worker(int id) : own_id{id}, worker{multi_pop_steal, this, id} {}
-
-   bool joinable() {
-      return worker.joinable();
-   }
-
-   void join() {
-      worker.join();
-   }
-
-   /* tests concurrent pops and steals. */
-   void multi_pop_steal(int mid) {
-      std::unique_lock lck{mu};
-      if (!flag.load()) {
-         std::cout << "Processor " << mid << " sleeping...\n";
-         cv.wait(lck, []() { return flag.load(); });
-         std::cout << "Processor " << mid << " awake...\n"; 
-      }
-      int popcount = 0;
-      int stealcount = 0;
-      lck.unlock();
-      TaskInfo holder;
-      while (!jobs.empty()) {
-         if (jobs.pop(holder)) {
-            holder();
-            popcount++;
-         }
-      }
-      while (!sibling->jobs.empty()) {
-         if (sibling->jobs.steal(holder)) {
-            holder();
-            stealcount++;
-         } 
-      }
-      lck.lock();
-      std::cout << "Processor " << mid << " done...\n";
-      std::cout << "   popcount = " << popcount << " tasks\n";
-      std::cout << "   stealcount = " << stealcount << " tasks\n";
-      lck.unlock();
-   }
-};
+using Clock = std::chrono::steady_clock;
 
-/* Tests whether given size is equal to size of queue, throws error if not */
-void assert_size(int size, WorkStealingQueue &queue, const char *caller) {
-   if (size != queue.size()) {
-      SetConsoleTextAttribute(console, 12);
+void check(const bool passed, const char *caller, const std::string &what) {
+   if (!passed) {
       std::cerr << "ERROR - " << caller << "()\n";
       std::cerr << "-----------------------------\n";
-      SetConsoleTextAttribute(console, 15);
-      std::cerr << "expected size = " << size << '\n';
-      std::cerr << "actual size = " << queue.size() << '\n';
-      exit(1);
-   } 
-   SetConsoleTextAttribute(console, 10);
-   std::cout << caller << "() [assert_size] PASSED\n";
-   SetConsoleTextAttribute(console, 15);
-}
-
-/* Tests whether the given list and the contents of the queue are equal, throws error if not.
-If successful, the queue will be left empty */
-void assert_equals(Comparator names, WorkStealingQueue &queue, const char *caller) {
-   TaskInfo holder;
-   int index = names.size();
-   Comparator::iterator iter = names.end();
-   while (iter != names.begin()) {
-      iter--;
-      index--;
-      queue.pop(holder);
-      if (holder.mname != *iter) {
-         SetConsoleTextAttribute(console, 12);
-         std::cerr << "ERROR - " << caller << "()\n";
-         std::cerr << "-----------------------------\n";
-         SetConsoleTextAttribute(console, 15);
-         std::cerr << "expected at index " << index << ": \"" << *iter << "\"\n";
-         std::cerr << "actual at index " << index << ": \"" << holder.mname << "\"\n";
-         exit(1);
-      }
+      std::cerr << what << '\n';
+      std::exit(1);
    }
-   SetConsoleTextAttribute(console, 10);
-   std::cout << caller << "() [assert_equals] PASSED\n";
-   SetConsoleTextAttribute(console, 15);
 }
 
-/* Tests whether the given queue is empty, throws error if not */
-void assert_empty(WorkStealingQueue &queue, const char *caller) {
-   if (!queue.empty()) {
-      SetConsoleTextAttribute(console, 12);
-      std::cerr << "ERROR - " << caller << "()\n";
-      std::cerr << "-----------------------------\n";
-      SetConsoleTextAttribute(console, 15);
-      std::cerr << "queue should be empty but size is " << queue.size() << '\n';
-      exit(1);
-   }
-   SetConsoleTextAttribute(console, 10);
-   std::cout << caller << "() [assert_empty] PASSED\n";
-   SetConsoleTextAttribute(console, 15);
+void passed(const char *caller) {
+   std::cout << caller << "() PASSED\n";
 }
 
-/* pushes the given amount of elements allowed into the queue */
-void push_many(int num, int id, WorkStealingQueue &queue) {
-   num = std::min(num, max_bufsize);
-   for (int i = 0; i < num; i++) {
-      queue.push(TaskInfo{Executor::make_closure(
-         [id]() {
-            counter[id].fetch_add(1, std::memory_order_acq_rel);
-         })
-      });
+/* tasks identified by their index, so consumers can account for each one */
+std::unique_ptr<TaskInfo[]> make_tasks(const size_t count) {
+   std::unique_ptr<TaskInfo[]> tasks{new TaskInfo[count]};
+   for (size_t i = 0; i < count; i++) {
+      tasks[i].id = i;
    }
+   return tasks;
 }
 
-/* pushes the maximum amount of elements allowed into the queue, then pops all elements off */
-void push_then_pop_all(WorkStealingQueue &queue) {
-   while (queue.push(TaskInfo{})) {}
-   assert_size(max_bufsize, queue, "push_then_pop_all");
-   TaskInfo holder;
-   while (queue.pop(holder)) {}
-   assert_empty(queue, "push_then_pop_all");
-}
-
-/* pushes the maximum amount of elements allowed into the queue, then steals all elements */
-void push_then_steal_all(WorkStealingQueue &queue) {
-   while (queue.push(TaskInfo{})) {}
-   assert_size(max_bufsize, queue, "push_then_steal_all");
-   TaskInfo holder;
-   while (queue.steal(holder)) {}
-   assert_empty(queue, "push_then_steal_all");
+/* the owner pops in reverse push order */
+void basic_pop() {
+   WorkStealingQueue queue;
+   auto tasks = make_tasks(3);
+   for (int i = 0; i < 3; i++) {
+      queue.push(&tasks[i]);
+   }
+   check(queue.size() == 3, __func__, "size should be 3");
+   for (int i = 2; i >= 0; i--) {
+      TaskInfo *task = queue.pop();
+      check(task == &tasks[i], __func__, "expected task " + std::to_string(i));
+   }
+   check(queue.pop() == nullptr && queue.empty(), __func__, "queue should be empty");
+   passed(__func__);
 }
 
-/* tests whether the queue will pop an invalid element. If so, then throws an error */
-void invalid_pop(WorkStealingQueue &queue) {
-   TaskInfo a;
-   a.num_deps = 1;
-   queue.push(std::move(a));
-   TaskInfo holder;
-   if (queue.pop(holder)) {
-      SetConsoleTextAttribute(console, 12);
-      std::cerr << "ERROR - invalid_pop()\n";
-      std::cerr << "-----------------------------\n";
-      SetConsoleTextAttribute(console, 15);
-      std::cerr << "queue popped but indegree was 1\n";
-      exit(1);
+/* thieves take in push order */
+void basic_steal() {
+   WorkStealingQueue queue;
+   auto tasks = make_tasks(3);
+   for (int i = 0; i < 3; i++) {
+      queue.push(&tasks[i]);
+   }
+   for (int i = 0; i < 3; i++) {
+      TaskInfo *task = queue.steal();
+      check(task == &tasks[i], __func__, "expected task " + std::to_string(i));
    }
-   assert_size(1, queue, "invalid_pop");
-   queue.clear();
+   check(queue.steal() == nullptr && queue.empty(), __func__, "queue should be empty");
+   passed(__func__);
 }
 
-/* tests whether the queue will steal an invalid element. If so, then throws an error */
-void invalid_steal(WorkStealingQueue &queue) {
-   TaskInfo a;
-   a.num_deps = 1;
-   queue.push(std::move(a));
-   TaskInfo holder;
-   if (queue.steal(holder)) {
-      SetConsoleTextAttribute(console, 12);
-      std::cerr << "ERROR - invalid_pop()\n";
-      std::cerr << "-----------------------------\n";
-      SetConsoleTextAttribute(console, 15);
-      std::cerr << "queue stolen from but indegree was " << a.num_deps << '\n';
-      exit(1);
+/* the ring grows past its initial capacity and shrinks back, keeping every task */
+void grow_and_shrink() {
+   WorkStealingQueue queue{4};
+   const size_t count = 4 * bs;
+   auto tasks = make_tasks(count);
+   for (size_t i = 0; i < count; i++) {
+      queue.push(&tasks[i]);
+   }
+   check(queue.size() == static_cast<int>(count), __func__, "size should match pushes");
+   check(queue.capacity() >= static_cast<int>(count), __func__, "ring should have grown");
+   for (size_t i = count; i > 0; i--) {
+      check(queue.pop() == &tasks[i - 1], __func__, "pop out of order at " + std::to_string(i - 1));
    }
-   assert_size(1, queue, "invalid_steal");
-   queue.clear();
+   check(queue.capacity() < static_cast<int>(count), __func__, "ring should have shrunk");
+   check(queue.empty(), __func__, "queue should be empty");
+   passed(__func__);
 }
 
-/* initializes queue with three elements, each with names "a", "b", and "c" */
-void init_elems(WorkStealingQueue &queue) {
-   TaskInfo a, b, c;
-   a.mname = "a";
-   b.mname = "b";
-   c.mname = "c";
-   queue.push(std::move(a));
-   queue.push(std::move(b));
-   queue.push(std::move(c));
+/* steal_half takes one task to return and moves up to half the rest to the thief */
+void batch_steal() {
+   WorkStealingQueue victim;
+   WorkStealingQueue thief;
+   auto tasks = make_tasks(9);
+   for (int i = 0; i < 9; i++) {
+      victim.push(&tasks[i]);
+   }
+   check(victim.steal_half(thief) == &tasks[0], __func__, "should return the oldest task");
+   check(thief.size() == 4 && victim.size() == 4, __func__, "should split the remaining 8 evenly");
+   check(thief.steal() == &tasks[1], __func__, "moved tasks should keep their order");
+   passed(__func__);
 }
 
-/* initializes 3 elements in the queue */
-void basic_push(WorkStealingQueue &queue) {
-   init_elems(queue);
-   assert_size(3, queue, "basic_push");
-   assert_equals({"a", "b", "c"}, queue, "basic_push");
-   assert_empty(queue, "basic_push");
+/* the owner pushes ids in increasing order while popping some of them back, and
+thieves steal, some in batches. every task must be taken exactly once, and a
+thief taking single tasks must see ids in increasing order, since the front only
+moves forward over tasks pushed in that order */
+void stress(const int num_thieves, const size_t count, const int rounds) {
+   for (int round = 0; round < rounds; round++) {
+      WorkStealingQueue queue{4};
+      auto tasks = make_tasks(count);
+      std::unique_ptr<std::atomic<int>[]> taken{new std::atomic<int>[count]};
+      for (size_t i = 0; i < count; i++) {
+         taken[i].store(0, std::memory_order_relaxed);
+      }
+      std::atomic<bool> pushing{true};
+      std::atomic<int> misordered{0};
+      std::vector<std::thread> thieves;
+      for (int t = 0; t < num_thieves; t++) {
+         thieves.emplace_back([&, t]() {
+            const bool batched = t % 2 == 1;
+            WorkStealingQueue own;
+            size_t last = 0;
+            bool first = true;
+            while (pushing.load(std::memory_order_acquire) || !queue.empty()) {
+               TaskInfo *task = batched ? queue.steal_half(own) : queue.steal();
+               if (task == nullptr) {
+                  continue;
+               }
+               if (!batched) {
+                  if (!first && task->id <= last) {
+                     misordered.fetch_add(1, std::memory_order_relaxed);
+                  }
+                  first = false;
+                  last = task->id;
+               }
+               taken[task->id].fetch_add(1, std::memory_order_relaxed);
+               while (TaskInfo *more = own.pop()) {
+                  taken[more->id].fetch_add(1, std::memory_order_relaxed);
+               }
+            }
+         });
+      }
+      // bursts of pushes, larger than the ring, followed by a few pops
+      uint64_t seed = 0x9E3779B97F4A7C15ull + round;
+      size_t next = 0;
+      while (next < count) {
+         seed ^= seed << 13;
+         seed ^= seed >> 7;
+         seed ^= seed << 17;
+         const size_t burst = std::min<size_t>(1 + seed % 256, count - next);
+         for (size_t i = 0; i < burst; i++) {
+            queue.push(&tasks[next++]);
+         }
+         for (size_t i = (seed >> 8) % 4; i > 0; i--) {
+            if (TaskInfo *task = queue.pop()) {
+               taken[task->id].fetch_add(1, std::memory_order_relaxed);
+            }
+         }
+         queue.reclaim();
+      }
+      while (TaskInfo *task = queue.pop()) {
+         taken[task->id].fetch_add(1, std::memory_order_relaxed);
+      }
+      pushing.store(false, std::memory_order_release);
+      for (auto &thief : thieves) {
+         thief.join();
+      }
+      size_t lost = 0;
+      size_t repeated = 0;
+      for (size_t i = 0; i < count; i++) {
+         const int times = taken[i].load(std::memory_order_relaxed);
+         lost += times == 0;
+         repeated += times > 1;
+      }
+      check(lost == 0 && repeated == 0 && misordered.load() == 0, __func__,
+         "round " + std::to_string(round) + ": " + std::to_string(lost) + " lost, "
+         + std::to_string(repeated) + " taken more than once, "
+         + std::to_string(misordered.load()) + " stolen out of order");
+   }
+   std::cout << __func__ << "() PASSED, " << rounds << " rounds of " << count << " tasks, "
+      << num_thieves << " thieves\n";
 }
 
-/* initializes 3 elements in the queue, then pops one element */
-void basic_pop(WorkStealingQueue &queue) {
-   init_elems(queue);
-   TaskInfo c;
-   queue.pop(c);
-   assert_size(2, queue, "basic_pop");
-   assert_equals({"a", "b"}, queue, "basic_pop");
-   assert_empty(queue, "basic_pop");
+double nanos_since(const Clock::time_point start) {
+   return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
 }
 
-/* initializes 3 elements in the queue, then steals one element */
-void basic_steal(WorkStealingQueue &queue) {
-   init_elems(queue);
-   TaskInfo a;
-   queue.steal(a);
-   assert_size(2, queue, "basic_steal");
-   assert_equals({"b", "c"}, queue, "basic_steal");
-   assert_empty(queue, "basic_steal");
+/* owner pushes then pops count tasks with no thieves about */
+void bench_owner(const size_t count) {
+   WorkStealingQueue queue;
+   auto tasks = make_tasks(count);
+   auto start = Clock::now();
+   for (size_t i = 0; i < count; i++) {
+      queue.push(&tasks[i]);
+   }
+   const double push_ns = nanos_since(start);
+   start = Clock::now();
+   while (queue.pop() != nullptr) {}
+   const double pop_ns = nanos_since(start);
+   std::printf("%-28s %10.1f ns/op %12.0f ops/s\n", "push, no thieves", push_ns / count,
+      count * 1e9 / push_ns);
+   std::printf("%-28s %10.1f ns/op %12.0f ops/s\n", "pop, no thieves", pop_ns / count,
+      count * 1e9 / pop_ns);
 }
 
-int main() {
-   {
-      WorkStealingQueue queue{};
-
-      /* Basic Single-Threaded Tests */
-      std::cout << "single-threaded...\n\n";
-      basic_push(queue);
-      basic_pop(queue);
-      basic_steal(queue);
-      push_then_pop_all(queue);
-      push_then_steal_all(queue);
-      invalid_pop(queue);
-      invalid_steal(queue);
+/* the owner fills the queue, then thieves drain it. every 64th steal is timed on
+its own for the latency percentiles */
+void bench_steal(const int num_thieves, const size_t count, const bool batched) {
+   WorkStealingQueue queue;
+   auto tasks = make_tasks(count);
+   for (size_t i = 0; i < count; i++) {
+      queue.push(&tasks[i]);
    }
-   std::array<int, 7> expected;
-   {
-      /* Initializing Threads */
-      std::cout << "\ninitializing processors...\n" << std::endl;
-      std::vector<Worker> threads;
-      int num_threads = std::thread::hardware_concurrency() - 1;
-      threads.reserve(num_threads);
-      threads.emplace_back(0);
-      push_many(max_bufsize / 7, 0, threads[0].jobs);
-      expected[0] = max_bufsize / 7;
-      for (int i = 1; i < num_threads; i++) {
-         threads.emplace_back(i);
-         expected[i] = max_bufsize * (i + 1) / 7;
-         push_many(max_bufsize * (i + 1) / 7, i, threads[i].jobs);
-         threads[i - 1].sibling = &threads[i];
-      }
-      threads[num_threads - 1].sibling = &threads[0];
-
-      /* Wait for input for threads to start popping/stealing */
-      if (std::cin.get()) {
-         flag = true;
-         cv.notify_all();
-      }
-      /* wait for threads to join */
-      for (auto &t : threads) {
-         if (t.joinable()) {
-            t.join();
+   std::atomic<bool> go{false};
+   std::vector<std::vector<double>> latencies(num_thieves);
+   std::vector<std::thread> thieves;
+   for (int t = 0; t < num_thieves; t++) {
+      thieves.emplace_back([&, t]() {
+         WorkStealingQueue own;
+         uint64_t attempts = 0;
+         while (!go.load(std::memory_order_acquire)) {}
+         while (!queue.empty()) {
+            const bool timed = attempts++ % 64 == 0;
+            const auto start = timed ? Clock::now() : Clock::time_point{};
+            TaskInfo *task = batched ? queue.steal_half(own) : queue.steal();
+            if (timed && task != nullptr) {
+               latencies[t].push_back(nanos_since(start));
+            }
+            while (own.pop() != nullptr) {}
          }
-      }
+      });
    }
-
-   /* print counter values */
-   std::cout << "result values: \n";
-   std::cout << "[" << counter[0];
-   for (int i = 1; i < counter.size(); i++) {
-      std::cout << ", " << counter[i];
+   const auto start = Clock::now();
+   go.store(true, std::memory_order_release);
+   for (auto &thief : thieves) {
+      thief.join();
    }
-   std::cout << "]\n\n";
-
-   /* print expected values */
-   std::cout << "expected values: \n";
-   std::cout << "[" << expected[0];
-   for (int i = 1; i < expected.size(); i++) {
-      std::cout << ", " << expected[i];
+   const double total_ns = nanos_since(start);
+   std::vector<double> all;
+   for (auto &samples : latencies) {
+      all.insert(all.end(), samples.begin(), samples.end());
    }
-   std::cout << "]\n\n";
-   
-   int errorcnt = 0;
-   for (int i = 0; i < expected.size(); i++) {
-      if (counter[i] != expected[i]) {
-         if (errorcnt <= 0) {
-            SetConsoleTextAttribute(console, 12);
-            std::cerr << "ERROR - values don't match!\n";
-            std::cerr << "-----------------------------\n";
-            SetConsoleTextAttribute(console, 15);
+   std::sort(all.begin(), all.end());
+   const double p50 = all.empty() ? 0.0 : all[all.size() / 2];
+   const double p99 = all.empty() ? 0.0 : all[all.size() * 99 / 100];
+   const std::string label = std::string{batched ? "steal_half" : "steal"} + ", "
+      + std::to_string(num_thieves) + " thieves";
+   std::printf("%-28s %10.1f ns/task %10.0f tasks/s   call p50 %.0f ns  p99 %.0f ns\n",
+      label.c_str(), total_ns / count, count * 1e9 / total_ns, p50, p99);
+}
+
+/* the owner pushes and pops in pairs while thieves steal, the pattern of a worker
+running a graph */
+void bench_contended(const int num_thieves, const size_t count) {
+   WorkStealingQueue queue;
+   auto tasks = make_tasks(count);
+   std::atomic<bool> running{true};
+   std::atomic<uint64_t> stolen{0};
+   std::vector<std::thread> thieves;
+   for (int t = 0; t < num_thieves; t++) {
+      thieves.emplace_back([&]() {
+         uint64_t mine = 0;
+         while (running.load(std::memory_order_acquire)) {
+            mine += queue.steal() != nullptr;
          }
-         SetConsoleTextAttribute(console, 14);
-         std::cerr << "at index " << i << ":\n";
-         SetConsoleTextAttribute(console, 15);
-         std::cerr << "   actual   <" << counter[i] << "> " << '\n';
-         std::cerr << "   expected <" << expected[i] << "> " << '\n';
-         errorcnt++;
-      }
+         stolen.fetch_add(mine, std::memory_order_relaxed);
+      });
+   }
+   const auto start = Clock::now();
+   for (size_t i = 0; i + 1 < count; i += 2) {
+      queue.push(&tasks[i]);
+      queue.push(&tasks[i + 1]);
+      queue.pop();
    }
-   if (errorcnt <= 0) {
-      SetConsoleTextAttribute(console, 10);
-      std::cout << "counter values match!\n";
-      SetConsoleTextAttribute(console, 15);
+   while (queue.pop() != nullptr) {}
+   const double total_ns = nanos_since(start);
+   running.store(false, std::memory_order_release);
+   for (auto &thief : thieves) {
+      thief.join();
    }
+   const std::string label = "owner, " + std::to_string(num_thieves) + " thieves";
+   std::printf("%-28s %10.1f ns/push %10.0f pushes/s   %llu stolen\n", label.c_str(),
+      total_ns / count, count * 1e9 / total_ns,
+      static_cast<unsigned long long>(stolen.load()));
+}
+
+void bench(const int num_thieves, const size_t count) {
+   bench_owner(count);
+   for (int thieves = 1; thieves <= num_thieves; thieves *= 2) {
+      bench_steal(thieves, count, false);
+      bench_steal(thieves, count, true);
+      bench_contended(thieves, count);
+   }
+}
 
+int main(int argc, char **argv) {
+   const std::string mode = (argc > 1) ? argv[1] : "";
+   const int hardware = std::max(2u, std::thread::hardware_concurrency());
+   const int thieves = (argc > 2) ? std::max(1, std::atoi(argv[2])) : std::max(3, hardware - 1);
+   if (mode == "stress") {
+      const size_t count = (argc > 3) ? std::strtoull(argv[3], nullptr, 10) : 1000000;
+      const int rounds = (argc > 4) ? std::max(1, std::atoi(argv[4])) : 10;
+      stress(thieves, count, rounds);
+   } else if (mode == "bench") {
+      bench(thieves, (argc > 3) ? std::strtoull(argv[3], nullptr, 10) : 1000000);
+   } else if (mode.empty()) {
+      std::cout << "single-threaded...\n\n";
+      basic_pop();
+      basic_steal();
+      grow_and_shrink();
+      batch_steal();
+      std::cout << "\nmulti-threaded...\n\n";
+      stress(thieves, 100000, 5);
+      std::cout << "\nbenchmark...\n\n";
+      bench(thieves, 100000);
+   } else {
+      std::cerr << "usage: queuetest [stress [thieves] [items] [rounds] | bench [thieves] [items]]\n";
+      return 2;
+   }
    return 0;
 }
 
 }
 
-int main() {
-   Test::main();
-}
\ No newline at end of file
+int main(int argc, char **argv) {
+   return Test::main(argc, argv);
+}
@@ -0,0 +1,125 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdlib>
+
+#include "../src/Parallel/Scheduler.hpp"
+
+/* checks the results of tasks and the values they pass to the tasks bound to them,
+within a run and across repeated runs. exits with 1 on the first failed check */
+
+using namespace Parallel;
+
+namespace Test {
+
+void check(const bool passed, const char *caller, const std::string &what) {
+   if (!passed) {
+      std::cerr << "ERROR - " << caller << "()\n";
+      std::cerr << "-----------------------------\n";
+      std::cerr << what << '\n';
+      std::exit(1);
+   }
+}
+
+void passed(const char *caller) {
+   std::cout << caller << "() PASSED\n";
+}
+
+/* a move-only value is moved from the producer's slot into the task bound to it,
+once per run, with no edge declared by hand */
+void move_only(ThreadPool &pool) {
+   Scheduler graph{pool};
+   int run = 0;
+   int sum = 0;
+   auto [make, made] = graph.add([&run]() { return std::make_unique<int>(++run); });
+   auto [take, taken] = graph.add([&sum](std::unique_ptr<int> value) {
+      sum += *value;
+      return value != nullptr;
+   }, made);
+   graph.run_n(3);
+   graph.wait();
+   check(sum == 1 + 2 + 3, __func__, "the consumer summed " + std::to_string(sum)
+      + " over 3 runs, expected 6");
+   check(taken.get(), __func__, "the consumer should have received a value");
+   passed(__func__);
+}
+
+/* bound plain arguments are copies kept with the task, Results are wired and fed
+each run's value */
+void mixed_arguments(ThreadPool &pool) {
+   Scheduler graph{pool};
+   int base = 100;
+   auto [left, left_value] = graph.add([&base]() { return base; });
+   auto [right, right_value] = graph.add([]() { return std::string{"abc"}; });
+   auto [join, joined] = graph.add([](int offset, int number, std::string text) {
+      return std::to_string(offset + number) + text;
+   }, 5, left_value, right_value);
+   graph.execute();
+   graph.wait();
+   check(joined.get() == "105abc", __func__, "the join gave " + joined.get());
+   base = 200;
+   graph.execute();
+   graph.wait();
+   check(joined.get() == "205abc", __func__, "the second run gave " + joined.get());
+   passed(__func__);
+}
+
+/* get() after run_n reads the last repeat's value, and each repeat's consumer saw
+the value of its own repeat */
+void repeated_runs(ThreadPool &pool) {
+   Scheduler graph{pool};
+   std::atomic<int> run{0};
+   std::vector<int> seen;
+   auto [count, counted] = graph.add([&run]() { return ++run; });
+   auto [square, squared] = graph.add([&seen](const int value) {
+      seen.push_back(value);
+      return value * value;
+   }, counted);
+   graph.run_n(5);
+   graph.wait();
+   check(squared.get() == 25, __func__, "get() after run_n(5) gave "
+      + std::to_string(squared.get()));
+   bool in_order = seen.size() == 5;
+   for (size_t i = 0; in_order && i < seen.size(); i++) {
+      in_order = seen[i] == static_cast<int>(i + 1);
+   }
+   check(in_order, __func__, "the consumer should see 1 to 5 in turn");
+   graph.run_until([&run]() { return run >= 8; });
+   graph.wait();
+   check(squared.get() == 64, __func__, "get() after run_until gave "
+      + std::to_string(squared.get()));
+   passed(__func__);
+}
+
+/* one Result handle kept by the caller reads every run's value in turn, and ready()
+holds between runs */
+void reused_handle(ThreadPool &pool) {
+   Scheduler graph{pool};
+   std::string suffix = "a";
+   auto [grow, grown] = graph.add([&suffix]() { return suffix += "b"; });
+   for (int run = 1; run <= 4; run++) {
+      graph.execute();
+      graph.wait();
+      check(grown.ready(), __func__, "the result should stay ready after the run");
+      check(grown.get() == "a" + std::string(run, 'b'), __func__, "run " + std::to_string(run)
+         + " gave " + grown.get());
+   }
+   passed(__func__);
+}
+
+int main() {
+   ThreadPool pool{4};
+   move_only(pool);
+   mixed_arguments(pool);
+   repeated_runs(pool);
+   reused_handle(pool);
+   return 0;
+}
+
+}
+
+int main() {
+   return Test::main();
+}
@@ -0,0 +1,203 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+
+#include "../src/Parallel/Scheduler.hpp"
+
+/* checks subflows: children finishing before the parent's successors, explicit
+joins, nesting, and the children being rebuilt on every run of their parent.
+exits with 1 on the first failed check */
+
+using namespace Parallel;
+
+namespace Test {
+
+void check(const bool passed, const char *caller, const std::string &what) {
+   if (!passed) {
+      std::cerr << "ERROR - " << caller << "()\n";
+      std::cerr << "-----------------------------\n";
+      std::cerr << what << '\n';
+      std::exit(1);
+   }
+}
+
+void passed(const char *caller) {
+   std::cout << caller << "() PASSED\n";
+}
+
+/* the parent returns at once, its successor still sees every child done */
+void before_successors(ThreadPool &pool) {
+   Scheduler graph{pool};
+   std::atomic<int> children{0};
+   int seen = -1;
+   auto parent = graph.silent_add([&children](Subflow &flow) {
+      for (int i = 0; i < 100; i++) {
+         flow.silent_add([&children]() { children++; });
+      }
+   });
+   auto after = graph.silent_add([&]() { seen = children.load(); });
+   graph.direct(parent, after);
+   for (int run = 1; run <= 20; run++) {
+      graph.execute();
+      graph.wait();
+      check(seen == 100 * run, __func__, "the successor saw " + std::to_string(seen)
+         + " children, expected " + std::to_string(100 * run));
+   }
+   passed(__func__);
+}
+
+/* join() returns with the children done, and children added after it are waited
+for once the parent returns */
+void explicit_join(ThreadPool &pool) {
+   Scheduler graph{pool};
+   std::atomic<int> first{0};
+   std::atomic<int> second{0};
+   int at_join = -1;
+   int seen = -1;
+   auto parent = graph.silent_add([&](Subflow &flow) {
+      auto a = flow.silent_add([&first]() { first++; });
+      auto b = flow.silent_add([&first]() { first++; });
+      auto c = flow.silent_add([&first]() { first++; });
+      flow.linearize(a, b, c);
+      flow.join();
+      at_join = first.load();
+      for (int i = 0; i < 10; i++) {
+         flow.silent_add([&second]() { second++; });
+      }
+   });
+   auto after = graph.silent_add([&]() { seen = second.load(); });
+   graph.direct(parent, after);
+   graph.execute();
+   graph.wait();
+   check(at_join == 3, __func__, "join() returned with " + std::to_string(at_join)
+      + " of 3 children done");
+   check(seen == 10, __func__, "the successor saw " + std::to_string(seen)
+      + " of the 10 children added after join()");
+   passed(__func__);
+}
+
+/* fib(n) by recursive subflows joined at each level */
+void fib(Subflow &flow, const int n, long &out) {
+   if (n < 2) {
+      out = n;
+      return;
+   }
+   long a = 0;
+   long b = 0;
+   flow.silent_add([&a, n](Subflow &inner) { fib(inner, n - 1, a); });
+   flow.silent_add([&b, n](Subflow &inner) { fib(inner, n - 2, b); });
+   flow.join();
+   out = a + b;
+}
+
+/* children spawning children, joined and not */
+void nested(ThreadPool &pool) {
+   Scheduler graph{pool};
+   long result = 0;
+   std::atomic<int> leaves{0};
+   int seen = -1;
+   graph.silent_add([&result](Subflow &flow) { fib(flow, 18, result); });
+   auto outer = graph.silent_add([&leaves](Subflow &flow) {
+      for (int i = 0; i < 4; i++) {
+         flow.silent_add([&leaves](Subflow &middle) {
+            for (int j = 0; j < 4; j++) {
+               middle.silent_add([&leaves](Subflow &inner) {
+                  for (int k = 0; k < 4; k++) {
+                     inner.silent_add([&leaves]() { leaves++; });
+                  }
+               });
+            }
+         });
+      }
+   });
+   auto after = graph.silent_add([&]() { seen = leaves.load(); });
+   graph.direct(outer, after);
+   graph.execute();
+   graph.wait();
+   check(result == 2584, __func__, "fib(18) gave " + std::to_string(result));
+   check(seen == 64, __func__, "the successor saw " + std::to_string(seen) + " of 64 leaves");
+   passed(__func__);
+}
+
+/* each run rebuilds the children in the parent's reused subgraph, with a different
+count and shape every time */
+void rerun(ThreadPool &pool) {
+   Scheduler graph{pool};
+   int run = 0;
+   std::vector<int> order;
+   std::atomic<int> children{0};
+   std::vector<int> seen;
+   auto parent = graph.silent_add([&](Subflow &flow) {
+      run++;
+      order.clear();
+      std::vector<Task> chain;
+      for (int i = 0; i < run; i++) {
+         chain.push_back(flow.silent_add([&order, &children, i]() {
+            order.push_back(i);
+            children++;
+         }));
+      }
+      for (size_t i = 1; i < chain.size(); i++) {
+         flow.direct(chain[i - 1], chain[i]);
+      }
+      if (run % 2 == 0) {
+         flow.join();
+      }
+   });
+   auto after = graph.silent_add([&]() { seen.push_back(children.exchange(0)); });
+   graph.direct(parent, after);
+   graph.run_n(8);
+   graph.wait();
+   for (int i = 0; i < 8; i++) {
+      check(seen.size() == 8 && seen[i] == i + 1, __func__, "run " + std::to_string(i + 1)
+         + " did not see its children done");
+   }
+   bool ordered = order.size() == 8;
+   for (size_t i = 0; ordered && i < order.size(); i++) {
+      ordered = order[i] == static_cast<int>(i);
+   }
+   check(ordered, __func__, "the last run's chain ran out of order");
+   passed(__func__);
+}
+
+/* four children of 20 ms joined by their parent count as their own work, and as
+the span in place of the parent's wait, not as the parent's time */
+void joined_report(ThreadPool &pool) {
+   using namespace std::chrono_literals;
+   Scheduler graph{pool};
+   graph.silent_add([](Subflow &flow) {
+      for (int i = 0; i < 4; i++) {
+         flow.silent_add([]() { std::this_thread::sleep_for(20ms); });
+      }
+      flow.join();
+   });
+   graph.execute();
+   graph.wait();
+   const RunReport report = graph.report();
+   const uint64_t child_ns = 20000000;
+   check(report.work_ns >= 4 * child_ns && report.work_ns < 6 * child_ns, __func__,
+      "work of " + std::to_string(report.work_ns) + " ns should count the four children once");
+   check(report.span_ns >= child_ns && report.span_ns <= report.makespan_ns, __func__,
+      "span of " + std::to_string(report.span_ns) + " ns should cover a child");
+   passed(__func__);
+}
+
+int main() {
+   ThreadPool pool{4};
+   before_successors(pool);
+   explicit_join(pool);
+   nested(pool);
+   rerun(pool);
+   joined_report(pool);
+   return 0;
+}
+
+}
+
+int main() {
+   return Test::main();
+}
@@ -1,9 +1,10 @@
 #include <iostream>
-#include "../src/Parallel/Task.hpp"
+#include "../src/Parallel/Graph.hpp"
 
 int main() {
    using namespace Parallel;
-   TaskInfo taskinfo{Executor::make_closure([]() { std::cout << "TaskInfo\n"; })};
+   NodeArena arena;
+   TaskInfo &taskinfo = arena.emplace(Executor::make_closure([]() { std::cout << "TaskInfo\n"; }));
    taskinfo();
    taskinfo.mname = "taskinfo";
    taskinfo();
@@ -12,7 +13,11 @@ int main() {
    exec();
    auto movedexec = std::move(exec);
    movedexec();
-   TaskInfo movedtaskinfo = std::move(taskinfo);
-   std::cout << movedtaskinfo.mname << '\n';
-   movedtaskinfo();
-}
\ No newline at end of file
+   for (size_t i = 1; i <= NodeArena::block_size; i++) {
+      arena.emplace(Executor::make_closure([]() {})).mname = "node " + std::to_string(i);
+   }
+   std::cout << arena.size() << " nodes, first still at " << &arena[0] << " = " << &taskinfo
+      << ": " << arena[0].mname << '\n';
+   arena[0]();
+   std::cout << arena[NodeArena::block_size].mname << '\n';
+}
@@ -0,0 +1,279 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+
+#include "../src/Parallel/Scheduler.hpp"
+
+/* checks the pool's counters against the tasks a graph ran, and that a dumped
+trace is valid JSON holding one complete event per task run. exits with 1 on the
+first failed check */
+
+using namespace Parallel;
+
+namespace Test {
+
+void check(const bool passed, const char *caller, const std::string &what) {
+   if (!passed) {
+      std::cerr << "ERROR - " << caller << "()\n";
+      std::cerr << "-----------------------------\n";
+      std::cerr << what << '\n';
+      std::exit(1);
+   }
+}
+
+void passed(const char *caller) {
+   std::cout << caller << "() PASSED\n";
+}
+
+/* a parsed JSON value, numbers and literals kept as their text */
+struct Json {
+   enum Kind { null, boolean, number, string, array, object } kind = null;
+   std::string text;
+   std::vector<Json> items;
+   std::map<std::string, Json> members;
+};
+
+/* strict recursive descent over the whole input, false on any syntax error */
+class Parser {
+   public:
+      Parser(const std::string &input) : in{input}, at{0} {}
+
+      bool parse(Json &out) {
+         return value(out) && (space(), at == in.size());
+      }
+   private:
+      void space() {
+         while (at < in.size() && std::isspace(static_cast<unsigned char>(in[at]))) {
+            at++;
+         }
+      }
+
+      bool literal(const std::string &word) {
+         if (in.compare(at, word.size(), word) != 0) {
+            return false;
+         }
+         at += word.size();
+         return true;
+      }
+
+      bool text(std::string &out) {
+         if (!literal("\"")) {
+            return false;
+         }
+         while (at < in.size() && in[at] != '"') {
+            const unsigned char c = static_cast<unsigned char>(in[at++]);
+            if (c < 0x20) {
+               return false;
+            }
+            if (c != '\\') {
+               out += static_cast<char>(c);
+               continue;
+            }
+            if (at == in.size()) {
+               return false;
+            }
+            const char escape = in[at++];
+            if (escape == 'u') {
+               if (at + 4 > in.size()) {
+                  return false;
+               }
+               for (size_t i = 0; i < 4; i++) {
+                  if (!std::isxdigit(static_cast<unsigned char>(in[at + i]))) {
+                     return false;
+                  }
+               }
+               out += static_cast<char>(std::stoi(in.substr(at, 4), nullptr, 16));
+               at += 4;
+            } else if (std::string{"\"\\/bfnrt"}.find(escape) != std::string::npos) {
+               out += escape;
+            } else {
+               return false;
+            }
+         }
+         return literal("\"");
+      }
+
+      bool numeral(std::string &out) {
+         const size_t start = at;
+         literal("-");
+         const size_t digits = at;
+         while (at < in.size() && std::isdigit(static_cast<unsigned char>(in[at]))) {
+            at++;
+         }
+         if (at == digits || (in[digits] == '0' && at > digits + 1)) {
+            return false;
+         }
+         if (literal(".")) {
+            const size_t fraction = at;
+            while (at < in.size() && std::isdigit(static_cast<unsigned char>(in[at]))) {
+               at++;
+            }
+            if (at == fraction) {
+               return false;
+            }
+         }
+         out = in.substr(start, at - start);
+         return true;
+      }
+
+      bool value(Json &out) {
+         space();
+         if (at == in.size()) {
+            return false;
+         }
+         if (in[at] == '{') {
+            out.kind = Json::object;
+            at++;
+            space();
+            if (literal("}")) {
+               return true;
+            }
+            do {
+               std::string key;
+               space();
+               if (!text(key) || (space(), !literal(":")) || !value(out.members[key])) {
+                  return false;
+               }
+               space();
+            } while (literal(","));
+            return literal("}");
+         }
+         if (in[at] == '[') {
+            out.kind = Json::array;
+            at++;
+            space();
+            if (literal("]")) {
+               return true;
+            }
+            do {
+               out.items.emplace_back();
+               if (!value(out.items.back())) {
+                  return false;
+               }
+               space();
+            } while (literal(","));
+            return literal("]");
+         }
+         if (in[at] == '"') {
+            out.kind = Json::string;
+            return text(out.text);
+         }
+         if (literal("true") || literal("false")) {
+            out.kind = Json::boolean;
+            return true;
+         }
+         if (literal("null")) {
+            return true;
+         }
+         out.kind = Json::number;
+         return numeral(out.text);
+      }
+
+      const std::string &in;
+      size_t at;
+};
+
+/* count independent tasks and a chain of count more */
+void build(Scheduler &graph, std::atomic<int> &ran, const int count) {
+   std::vector<Task> chain;
+   for (int i = 0; i < count; i++) {
+      graph.silent_add([&ran]() { ran++; }).name("free " + std::to_string(i));
+      chain.push_back(graph.silent_add([&ran]() { ran++; }));
+      chain.back().name("chain \"" + std::to_string(i) + "\"\\");
+   }
+   for (size_t i = 1; i < chain.size(); i++) {
+      graph.direct(chain[i - 1], chain[i]);
+   }
+}
+
+/* after a reset the pool counts exactly the tasks the runs ran, split over workers */
+void stats_count(ThreadPool &pool) {
+   Scheduler graph{pool};
+   std::atomic<int> ran{0};
+   build(graph, ran, 50);
+   graph.execute();
+   graph.wait();
+   pool.reset_stats();
+   ran = 0;
+   graph.run_n(3);
+   graph.wait();
+   const PoolStats stats = pool.stats();
+   if constexpr (!stats_enabled) {
+      check(stats.total.tasks == 0, __func__, "counting is off, the task count should be 0");
+      passed(__func__);
+      return;
+   }
+   check(ran == 300, __func__, std::to_string(ran.load()) + " tasks ran, expected 300");
+   check(stats.total.tasks == static_cast<uint64_t>(ran.load()), __func__, "the pool counted "
+      + std::to_string(stats.total.tasks) + " tasks, " + std::to_string(ran.load()) + " ran");
+   check(stats.workers.size() == static_cast<size_t>(pool.size()), __func__,
+      "one set of counters per worker expected");
+   WorkerStats sum;
+   for (auto &worker : stats.workers) {
+      sum += worker;
+   }
+   check(sum.tasks == stats.total.tasks && sum.exec_ns == stats.total.exec_ns, __func__,
+      "the total should be the sum of the workers");
+   pool.reset_stats();
+   check(pool.stats().total.tasks == 0, __func__, "a reset should clear the task count");
+   passed(__func__);
+}
+
+/* the dump parses as JSON, names every worker, and has one complete event per task
+run with its name escaped */
+void trace_json(ThreadPool &pool) {
+   Scheduler graph{pool};
+   std::atomic<int> ran{0};
+   build(graph, ran, 50);
+   pool.enable_tracing();
+   graph.run_n(2);
+   graph.wait();
+   std::ostringstream dump;
+   pool.dump_trace(dump);
+   pool.disable_tracing();
+   Json trace;
+   check(Parser{dump.str()}.parse(trace), __func__, "the trace is not valid JSON");
+   check(trace.kind == Json::object && trace.members["traceEvents"].kind == Json::array,
+      __func__, "the trace should be an object holding traceEvents");
+   std::map<std::string, int> runs;
+   int workers = 0;
+   for (auto &event : trace.members["traceEvents"].items) {
+      const std::string phase = event.members["ph"].text;
+      if (phase == "M") {
+         workers++;
+         continue;
+      }
+      check(phase == "X", __func__, "unexpected event phase " + phase);
+      check(event.members["ts"].kind == Json::number && event.members["dur"].kind == Json::number,
+         __func__, "a complete event needs a start and a duration");
+      runs[event.members["name"].text]++;
+   }
+   check(workers == pool.size(), __func__, std::to_string(workers) + " worker names for "
+      + std::to_string(pool.size()) + " workers");
+   check(runs.size() == 100, __func__, std::to_string(runs.size())
+      + " distinct task names traced, expected 100");
+   for (auto &[name, count] : runs) {
+      check(count == 2, __func__, name + " traced " + std::to_string(count)
+         + " times over 2 runs");
+   }
+   check(runs.count("chain \"7\"\\") == 1, __func__, "quotes and backslashes should round trip");
+   passed(__func__);
+}
+
+int main() {
+   ThreadPool pool{4};
+   stats_count(pool);
+   trace_json(pool);
+   return 0;
+}
+
+}
+
+int main() {
+   return Test::main();
+}